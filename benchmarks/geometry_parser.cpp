@@ -0,0 +1,179 @@
+// Compares the legacy getline/stringstream geometry parser with
+// GeometryParser on a generated text mesh and reports MB/s.
+//
+// Usage: geometry_parser_benchmark [num_vertices] [file]
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lumina/geometry_parser.hpp"
+
+namespace
+{
+    // The parser GeometryLoader used before GeometryParser, kept as a baseline
+    void parseLegacy(const std::string& filename,
+                     std::vector<float>& positions,
+                     std::vector<float>& colors,
+                     std::vector<float>& uvs,
+                     std::vector<unsigned int>& indices)
+    {
+        enum class Section { None, Positions, UVs, Indices };
+
+        std::ifstream file(filename);
+        std::string line;
+        Section current_section = Section::None;
+
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '\r')
+                continue;
+
+            if (line[0] == '#')
+            {
+                if (line == "#positions") current_section = Section::Positions;
+                else if (line == "#uvs") current_section = Section::UVs;
+                else if (line == "#indices") current_section = Section::Indices;
+                else current_section = Section::None;
+                continue;
+            }
+
+            std::stringstream ss(line);
+            switch (current_section)
+            {
+                case Section::Positions: {
+                    float x, y, z, r, g, b;
+                    if (ss >> x >> y >> z)
+                    {
+                        positions.push_back(x);
+                        positions.push_back(y);
+                        positions.push_back(z);
+                        if (ss >> r >> g >> b)
+                        {
+                            colors.push_back(r);
+                            colors.push_back(g);
+                            colors.push_back(b);
+                        }
+                        else
+                        {
+                            colors.push_back(1.0f);
+                            colors.push_back(1.0f);
+                            colors.push_back(1.0f);
+                        }
+                    }
+                    break;
+                }
+                case Section::UVs: {
+                    float u, v;
+                    if (ss >> u >> v)
+                    {
+                        uvs.push_back(u);
+                        uvs.push_back(v);
+                    }
+                    break;
+                }
+                case Section::Indices: {
+                    unsigned int i1, i2, i3;
+                    if (ss >> i1 >> i2 >> i3)
+                    {
+                        indices.push_back(i1);
+                        indices.push_back(i2);
+                        indices.push_back(i3);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    void generateMesh(const std::string& filename, size_t num_vertices)
+    {
+        std::FILE* file = std::fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            std::cerr << "Unable to write file: " << filename << std::endl;
+            std::exit(1);
+        }
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coord(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::fprintf(file, "#positions\n");
+        for (size_t i = 0; i < num_vertices; i++)
+        {
+            std::fprintf(file, "%.6f %.6f %.6f %.4f %.4f %.4f\n",
+                         coord(rng), coord(rng), coord(rng), unit(rng), unit(rng), unit(rng));
+        }
+
+        std::fprintf(file, "#uvs\n");
+        for (size_t i = 0; i < num_vertices; i++)
+        {
+            std::fprintf(file, "%.6f %.6f\n", unit(rng), unit(rng));
+        }
+
+        std::fprintf(file, "#indices\n");
+        for (size_t i = 0; i + 2 < num_vertices; i++)
+        {
+            std::fprintf(file, "%zu %zu %zu\n", i, i + 1, i + 2);
+        }
+
+        std::fclose(file);
+    }
+
+    template<typename Parse>
+    double measure(const char* label, double megabytes, Parse&& parse)
+    {
+        std::vector<float> positions, colors, uvs;
+        std::vector<unsigned int> indices;
+
+        auto start = std::chrono::steady_clock::now();
+        parse(positions, colors, uvs, indices);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%-24s %8.3f s %10.1f MB/s  (%zu vertices, %zu indices)\n",
+                    label, seconds, megabytes / seconds, positions.size() / 3, indices.size());
+        return seconds;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_vertices = argc > 1 ? std::stoull(argv[1]) : 10000000;
+    std::string filename = argc > 2 ? argv[2] : "geometry_benchmark.txt";
+
+    if (!std::filesystem::exists(filename))
+    {
+        std::cout << "Generating " << num_vertices << " vertices into " << filename << std::endl;
+        generateMesh(filename, num_vertices);
+    }
+
+    double megabytes = std::filesystem::file_size(filename) / (1024.0 * 1024.0);
+    std::printf("File: %s (%.1f MB)\n", filename.c_str(), megabytes);
+
+    double legacy = measure("legacy (stringstream)", megabytes,
+        [&](auto& positions, auto& colors, auto& uvs, auto& indices) {
+            parseLegacy(filename, positions, colors, uvs, indices);
+        });
+
+    double single = measure("GeometryParser 1 thread", megabytes,
+        [&](auto& positions, auto& colors, auto& uvs, auto& indices) {
+            lumina::GeometryParser::parseFile(filename, positions, colors, uvs, indices, 1);
+        });
+
+    double threaded = measure("GeometryParser auto", megabytes,
+        [&](auto& positions, auto& colors, auto& uvs, auto& indices) {
+            lumina::GeometryParser::parseFile(filename, positions, colors, uvs, indices);
+        });
+
+    std::printf("Speedup: %.1fx single threaded, %.1fx threaded\n", legacy / single, legacy / threaded);
+    return 0;
+}
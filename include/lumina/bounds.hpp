@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+namespace lumina
+{
+    // Axis aligned box plus bounding sphere. A default constructed Bounds is
+    // empty, which culling treats as "always visible".
+    struct Bounds
+    {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+
+        // positions is a flat xyz array of count vertices
+        static Bounds fromPositions(const float* positions, size_t count)
+        {
+            Bounds bounds;
+            for (size_t i = 0; i < count; i++)
+            {
+                glm::vec3 p(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+                bounds.min = glm::min(bounds.min, p);
+                bounds.max = glm::max(bounds.max, p);
+            }
+            if (bounds.isEmpty())
+                return bounds;
+
+            bounds.center = (bounds.min + bounds.max) * 0.5f;
+            for (size_t i = 0; i < count; i++)
+            {
+                glm::vec3 p(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+                bounds.radius = std::max(bounds.radius, glm::length(p - bounds.center));
+            }
+            return bounds;
+        }
+
+        // The sphere is the one around the box
+        static Bounds fromBox(const glm::vec3& box_min, const glm::vec3& box_max)
+        {
+            Bounds bounds;
+            if (box_min.x > box_max.x)
+                return bounds;
+            bounds.min = box_min;
+            bounds.max = box_max;
+            bounds.center = (box_min + box_max) * 0.5f;
+            bounds.radius = glm::length(box_max - bounds.center);
+            return bounds;
+        }
+
+        bool isEmpty() const { return min.x > max.x; }
+        glm::vec3 getExtent() const { return (max - min) * 0.5f; }
+
+        void merge(const Bounds& other)
+        {
+            if (other.isEmpty())
+                return;
+            if (isEmpty())
+            {
+                *this = other;
+                return;
+            }
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+            // Sphere around both spheres
+            glm::vec3 offset = other.center - center;
+            float distance = glm::length(offset);
+            if (distance + other.radius <= radius)
+                return;
+            if (distance + radius <= other.radius)
+            {
+                center = other.center;
+                radius = other.radius;
+                return;
+            }
+            float new_radius = (distance + radius + other.radius) * 0.5f;
+            center += offset * ((new_radius - radius) / distance);
+            radius = new_radius;
+        }
+
+        // Bounds of the transformed volume. The box is the box around the
+        // transformed box (Arvo), the sphere is scaled by the largest axis.
+        Bounds transformed(const glm::mat4& m) const
+        {
+            if (isEmpty())
+                return *this;
+
+            glm::vec3 box_center = glm::vec3(m * glm::vec4((min + max) * 0.5f, 1.0f));
+            glm::vec3 extent = getExtent();
+            glm::vec3 new_extent = glm::abs(glm::vec3(m[0])) * extent.x +
+                                   glm::abs(glm::vec3(m[1])) * extent.y +
+                                   glm::abs(glm::vec3(m[2])) * extent.z;
+
+            float scale = std::sqrt(std::max({glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                                              glm::dot(glm::vec3(m[1]), glm::vec3(m[1])),
+                                              glm::dot(glm::vec3(m[2]), glm::vec3(m[2]))}));
+
+            Bounds result;
+            result.min = box_center - new_extent;
+            result.max = box_center + new_extent;
+            result.center = glm::vec3(m * glm::vec4(center, 1.0f));
+            result.radius = radius * scale;
+            return result;
+        }
+    };
+}
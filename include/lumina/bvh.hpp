@@ -0,0 +1,415 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.hpp"
+#include "frustum.hpp"
+
+namespace lumina
+{
+    // Bounding volume hierarchy over items with axis aligned bounds.
+    //
+    // Items are identified by their index in the bounds array passed to
+    // build(). Nodes live in one array, the two children of an inner node
+    // are stored next to each other. Moved items are handled by refit(),
+    // which grows or shrinks the boxes up the tree; a refitted tree stays
+    // correct but gets looser, so callers rebuild once getCost() grew too
+    // much compared to getBuildCost().
+    class Bvh
+    {
+    public:
+        struct Node
+        {
+            glm::vec3 min;
+            uint32_t first;   // left child, or first entry in items for leaves
+            glm::vec3 max;
+            uint32_t count;   // number of items, 0 for inner nodes
+            int32_t parent;   // -1 for the root
+        };
+
+        static constexpr uint32_t INVALID = ~0u;
+        static constexpr unsigned int MAX_LEAF_ITEMS = 4;
+
+        // Binned SAH build over all non empty bounds
+        void build(const std::vector<Bounds>& bounds)
+        {
+            nodes.clear();
+            entries.clear();
+            item_leaf.assign(bounds.size(), INVALID);
+            item_entry.assign(bounds.size(), INVALID);
+
+            for (uint32_t i = 0; i < bounds.size(); i++)
+            {
+                if (!bounds[i].isEmpty())
+                    entries.push_back({bounds[i].min, i, bounds[i].max});
+            }
+
+            if (!entries.empty())
+            {
+                nodes.reserve(entries.size() * 2);
+                nodes.push_back({});
+                nodes[0].parent = -1;
+                split(0, 0, static_cast<uint32_t>(entries.size()));
+            }
+            for (uint32_t i = 0; i < entries.size(); i++)
+            {
+                item_entry[entries[i].item] = i;
+            }
+            cost = 0.0f;
+            for (const Node& node : nodes)
+            {
+                cost += area(node.min, node.max) * nodeWeight(node);
+            }
+            build_cost = cost;
+        }
+
+        // Updates the bounds of one item and of the nodes above it
+        void refit(uint32_t item, const Bounds& bounds)
+        {
+            if (item >= item_leaf.size() || item_leaf[item] == INVALID || bounds.isEmpty())
+                return;
+            entries[item_entry[item]].min = bounds.min;
+            entries[item_entry[item]].max = bounds.max;
+
+            int32_t index = static_cast<int32_t>(item_leaf[item]);
+            while (index >= 0)
+            {
+                Node& node = nodes[index];
+                glm::vec3 min, max;
+                if (node.count > 0)
+                {
+                    itemBounds(node.first, node.count, min, max);
+                }
+                else
+                {
+                    const Node& left = nodes[node.first];
+                    const Node& right = nodes[node.first + 1];
+                    min = glm::min(left.min, right.min);
+                    max = glm::max(left.max, right.max);
+                }
+                // Nothing above changes any more
+                if (min == node.min && max == node.max)
+                    break;
+                cost += (area(min, max) - area(node.min, node.max)) * nodeWeight(node);
+                node.min = min;
+                node.max = max;
+                index = node.parent;
+            }
+        }
+
+        bool contains(uint32_t item) const
+        {
+            return item < item_leaf.size() && item_leaf[item] != INVALID;
+        }
+
+        void queryBox(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& result) const
+        {
+            traverse([&](const glm::vec3& node_min, const glm::vec3& node_max) {
+                return glm::all(glm::lessThanEqual(node_min, max)) && glm::all(glm::greaterThanEqual(node_max, min));
+            }, result);
+        }
+
+        void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const
+        {
+            traverse([&](const glm::vec3& node_min, const glm::vec3& node_max) {
+                return frustum.intersectsBox(node_min, node_max);
+            }, result);
+        }
+
+        // Visits the items whose box the ray enters, nearest boxes first.
+        // intersect(item, max_distance) returns the hit distance along the
+        // ray or infinity; hits shrink the search range. Returns the nearest
+        // distance found, infinity when nothing was hit.
+        template<typename Function>
+        float raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance,
+                      Function&& intersect) const
+        {
+            float nearest = std::numeric_limits<float>::infinity();
+            if (nodes.empty())
+                return nearest;
+
+            const glm::vec3 inverse_direction = 1.0f / direction;
+            std::vector<std::pair<uint32_t, float>>& stack = traversal_stack;
+            stack.clear();
+
+            float entry;
+            if (intersectsRay(nodes[0], origin, inverse_direction, max_distance, entry))
+                stack.push_back({0, entry});
+
+            while (!stack.empty())
+            {
+                auto [index, node_entry] = stack.back();
+                stack.pop_back();
+                if (node_entry > max_distance)
+                    continue;
+
+                const Node& node = nodes[index];
+                if (node.count > 0)
+                {
+                    for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    {
+                        float distance = intersect(entries[i].item, max_distance);
+                        if (distance < max_distance)
+                        {
+                            max_distance = distance;
+                            nearest = distance;
+                        }
+                    }
+                    continue;
+                }
+
+                float left_entry, right_entry;
+                bool left = intersectsRay(nodes[node.first], origin, inverse_direction, max_distance, left_entry);
+                bool right = intersectsRay(nodes[node.first + 1], origin, inverse_direction, max_distance, right_entry);
+                // The nearer child goes on top
+                if (left && right && left_entry < right_entry)
+                {
+                    stack.push_back({node.first + 1, right_entry});
+                    stack.push_back({node.first, left_entry});
+                }
+                else
+                {
+                    if (left)
+                        stack.push_back({node.first, left_entry});
+                    if (right)
+                        stack.push_back({node.first + 1, right_entry});
+                }
+            }
+            return nearest;
+        }
+
+        // Surface area heuristic cost of the current tree: box areas weighted
+        // by the traversal cost of inner nodes and the item tests of leaves.
+        // Kept up to date by refit(), so it grows as the boxes get looser.
+        float getCost() const { return cost; }
+
+        float getBuildCost() const { return build_cost; }
+        const std::vector<Node>& getNodes() const { return nodes; }
+        size_t getItemCount() const { return entries.size(); }
+
+    private:
+        static constexpr unsigned int BIN_COUNT = 12;
+        static constexpr float TRAVERSAL_COST = 1.0f;
+
+        std::vector<Node> nodes;
+        // Leaf contents, every leaf owns a contiguous range
+        struct Entry
+        {
+            glm::vec3 min;
+            uint32_t item;
+            glm::vec3 max;
+        };
+        std::vector<Entry> entries;
+        std::vector<uint32_t> item_leaf;   // leaf node of every item, INVALID if not in the tree
+        std::vector<uint32_t> item_entry;  // position in entries
+        float cost = 0.0f;
+        float build_cost = 0.0f;
+        mutable std::vector<std::pair<uint32_t, float>> traversal_stack;
+
+        static float area(const glm::vec3& min, const glm::vec3& max)
+        {
+            glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+
+        static float nodeWeight(const Node& node)
+        {
+            return node.count > 0 ? static_cast<float>(node.count) : TRAVERSAL_COST;
+        }
+
+        void itemBounds(uint32_t first, uint32_t count, glm::vec3& min, glm::vec3& max) const
+        {
+            min = glm::vec3(std::numeric_limits<float>::max());
+            max = glm::vec3(-std::numeric_limits<float>::max());
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                min = glm::min(min, entries[i].min);
+                max = glm::max(max, entries[i].max);
+            }
+        }
+
+        void makeLeaf(uint32_t index, uint32_t first, uint32_t count)
+        {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                item_leaf[entries[i].item] = index;
+            }
+        }
+
+        void split(uint32_t index, uint32_t first, uint32_t count)
+        {
+            glm::vec3& node_min = nodes[index].min;
+            glm::vec3& node_max = nodes[index].max;
+            node_min = glm::vec3(std::numeric_limits<float>::max());
+            node_max = glm::vec3(-std::numeric_limits<float>::max());
+            glm::vec3 center_min = node_min, center_max = node_max;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const Entry& entry = entries[i];
+                node_min = glm::min(node_min, entry.min);
+                node_max = glm::max(node_max, entry.max);
+                glm::vec3 center = (entry.min + entry.max) * 0.5f;
+                center_min = glm::min(center_min, center);
+                center_max = glm::max(center_max, center);
+            }
+            if (count <= 1)
+            {
+                makeLeaf(index, first, count);
+                return;
+            }
+
+            // Bin the item centers along every axis and keep the cheapest
+            // split. Small nodes get fewer bins, they are the majority.
+            const unsigned int bin_count = std::min(BIN_COUNT, std::max(count, 4u));
+            int best_axis = -1;
+            unsigned int best_split = 0;
+            float best_cost = std::numeric_limits<float>::max();
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float extent = center_max[axis] - center_min[axis];
+                if (extent <= 0.0f)
+                    continue;
+
+                struct Bin
+                {
+                    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+                    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+                    uint32_t count = 0;
+                } bins[BIN_COUNT];
+
+                float scale = bin_count / extent;
+                for (uint32_t i = first; i < first + count; i++)
+                {
+                    const Entry& entry = entries[i];
+                    unsigned int bin = binIndex(entry, axis, center_min[axis], scale, bin_count);
+                    bins[bin].min = glm::min(bins[bin].min, entry.min);
+                    bins[bin].max = glm::max(bins[bin].max, entry.max);
+                    bins[bin].count++;
+                }
+
+                // Sweep from the right, then evaluate every plane from the left
+                float right_area[BIN_COUNT];
+                uint32_t right_count[BIN_COUNT];
+                Bin right;
+                for (unsigned int b = bin_count - 1; b > 0; b--)
+                {
+                    right.min = glm::min(right.min, bins[b].min);
+                    right.max = glm::max(right.max, bins[b].max);
+                    right.count += bins[b].count;
+                    right_area[b] = right.count ? area(right.min, right.max) : 0.0f;
+                    right_count[b] = right.count;
+                }
+
+                Bin left;
+                for (unsigned int b = 0; b + 1 < bin_count; b++)
+                {
+                    left.min = glm::min(left.min, bins[b].min);
+                    left.max = glm::max(left.max, bins[b].max);
+                    left.count += bins[b].count;
+                    if (left.count == 0 || right_count[b + 1] == 0)
+                        continue;
+                    float cost = area(left.min, left.max) * left.count + right_area[b + 1] * right_count[b + 1];
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = b + 1;
+                    }
+                }
+            }
+
+            float leaf_cost = area(node_min, node_max) * count;
+            float split_cost = area(node_min, node_max) * TRAVERSAL_COST + best_cost;
+            if (best_axis < 0 || (count <= MAX_LEAF_ITEMS && split_cost >= leaf_cost))
+            {
+                // All centers in one spot: split in the middle to bound leaf sizes
+                if (best_axis < 0 && count > MAX_LEAF_ITEMS)
+                {
+                    splitChildren(index, first, count / 2, count);
+                    return;
+                }
+                makeLeaf(index, first, count);
+                return;
+            }
+
+            float scale = bin_count / (center_max[best_axis] - center_min[best_axis]);
+            auto middle = std::partition(entries.begin() + first, entries.begin() + first + count, [&](const Entry& entry) {
+                return binIndex(entry, best_axis, center_min[best_axis], scale, bin_count) < best_split;
+            });
+            splitChildren(index, first, static_cast<uint32_t>(middle - (entries.begin() + first)), count);
+        }
+
+        static unsigned int binIndex(const Entry& entry, int axis, float origin, float scale, unsigned int bin_count)
+        {
+            float center = (entry.min[axis] + entry.max[axis]) * 0.5f;
+            return std::min(bin_count - 1, static_cast<unsigned int>((center - origin) * scale));
+        }
+
+        void splitChildren(uint32_t index, uint32_t first, uint32_t left_count, uint32_t count)
+        {
+            uint32_t left = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({});
+            nodes.push_back({});
+            nodes[left].parent = static_cast<int32_t>(index);
+            nodes[left + 1].parent = static_cast<int32_t>(index);
+            nodes[index].first = left;
+            nodes[index].count = 0;
+
+            split(left, first, left_count);
+            split(left + 1, first + left_count, count - left_count);
+        }
+
+        template<typename Overlaps>
+        void traverse(Overlaps&& overlaps, std::vector<uint32_t>& result) const
+        {
+            if (nodes.empty())
+                return;
+
+            std::vector<std::pair<uint32_t, float>>& stack = traversal_stack;
+            stack.clear();
+            stack.push_back({0, 0.0f});
+            while (!stack.empty())
+            {
+                const Node& node = nodes[stack.back().first];
+                stack.pop_back();
+                if (!overlaps(node.min, node.max))
+                    continue;
+
+                if (node.count > 0)
+                {
+                    for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    {
+                        if (overlaps(entries[i].min, entries[i].max))
+                            result.push_back(entries[i].item);
+                    }
+                }
+                else
+                {
+                    stack.push_back({node.first + 1, 0.0f});
+                    stack.push_back({node.first, 0.0f});
+                }
+            }
+        }
+
+        // Slab test, entry is the distance where the ray enters the box
+        static bool intersectsRay(const Node& node, const glm::vec3& origin, const glm::vec3& inverse_direction,
+                                  float max_distance, float& entry)
+        {
+            glm::vec3 t0 = (node.min - origin) * inverse_direction;
+            glm::vec3 t1 = (node.max - origin) * inverse_direction;
+            glm::vec3 t_near = glm::min(t0, t1);
+            glm::vec3 t_far = glm::max(t0, t1);
+            entry = std::max({t_near.x, t_near.y, t_near.z, 0.0f});
+            float exit = std::min({t_far.x, t_far.y, t_far.z, max_distance});
+            return entry <= exit;
+        }
+    };
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <GL/glew.h>
 
+#include "gl_state.hpp"
+
 namespace lumina {
 
 class FBO {
@@ -11,7 +13,7 @@ public:
 
         // Color texture
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        GLState::shared().bindTexture(0, GL_TEXTURE_2D, texture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
                      GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -39,6 +41,7 @@ public:
 
     ~FBO() {
         glDeleteFramebuffers(1, &fbo);
+        GLState::shared().forgetTexture(texture);
         glDeleteTextures(1, &texture);
         glDeleteRenderbuffers(1, &rbo);
     }
@@ -48,7 +51,7 @@ public:
 
     void bind() {
         glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glViewport(0, 0, width, height);
+        GLState::shared().viewport(0, 0, width, height);
     }
 
     static void unbind() {
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace lumina
+{
+    // Watches files for changes on a background thread, so nothing is
+    // stat'ed on the render thread. On Linux the directories of the watched
+    // files are registered with inotify, which also sees editors that save
+    // by renaming a new file over the old one. A directory stays registered
+    // while a file in it is watched. Elsewhere, when inotify is not
+    // available, or for files whose directory cannot be registered (yet),
+    // the thread compares modification times every POLL_INTERVAL.
+    //
+    // Changes are collected until dispatch(), which runs the callbacks on
+    // the calling thread, once per changed file. Viewport::swapBuffers()
+    // dispatches once per frame. watch(), unwatch() and dispatch() have to
+    // be called from the same thread.
+    class FileWatcher
+    {
+    public:
+        using Callback = std::function<void(const std::string& path)>;
+        using WatchId = uint64_t;
+
+        static constexpr std::chrono::milliseconds POLL_INTERVAL{250};
+
+        static FileWatcher& shared()
+        {
+            static FileWatcher watcher;
+            return watcher;
+        }
+
+        ~FileWatcher()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            if (thread.joinable())
+                thread.join();
+#ifdef __linux__
+            if (inotify_fd >= 0)
+                ::close(inotify_fd);
+#endif
+        }
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        // The callback runs in dispatch() after the file was written.
+        // Returns the id to pass to unwatch().
+        WatchId watch(const std::string& path, Callback callback)
+        {
+            return add(path, [callback = std::move(callback)](const std::string& changed) {
+                callback(changed);
+                return true;
+            });
+        }
+
+        // Same, but the callback gets the owner and the watch goes away with
+        // it instead of keeping it alive
+        template<typename T, typename F>
+        WatchId watch(const std::string& path, const std::shared_ptr<T>& owner, F callback)
+        {
+            std::weak_ptr<T> weak = owner;
+            return add(path, [weak, callback = std::move(callback)](const std::string& changed) {
+                std::shared_ptr<T> locked = weak.lock();
+                if (!locked)
+                    return false;
+                callback(*locked, changed);
+                return true;
+            });
+        }
+
+        void unwatch(WatchId id)
+        {
+            auto it = watches.find(id);
+            if (it == watches.end())
+                return;
+            std::string key = it->second.key;
+            watches.erase(it);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto file = files.find(key);
+            if (file == files.end() || --file->second.watchers > 0)
+                return;
+            unwatchDirectory(file->second.descriptor);
+            files.erase(file);
+        }
+
+        // Runs the callbacks of the files changed since the last call.
+        // Returns the number of changed files.
+        size_t dispatch()
+        {
+            if (!has_pending.load(std::memory_order_acquire))
+                return 0;
+
+            std::unordered_set<std::string> changed;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                changed.swap(pending);
+                has_pending.store(false, std::memory_order_relaxed);
+            }
+
+            // Callbacks may watch and unwatch, so they run from a copy
+            std::vector<std::pair<WatchId, Watch>> due;
+            for (const auto& [id, entry] : watches)
+            {
+                if (changed.count(entry.key))
+                    due.push_back({id, entry});
+            }
+            for (auto& [id, entry] : due)
+            {
+                if (!entry.callback(entry.path))
+                    unwatch(id);
+            }
+            return changed.size();
+        }
+
+        // False when changes are found by polling
+        bool usesInotify() const
+        {
+#ifdef __linux__
+            return inotify_fd >= 0;
+#else
+            return false;
+#endif
+        }
+
+    private:
+        struct Watch
+        {
+            std::string path;
+            std::string key;
+            // Returns false when the watch should be removed
+            std::function<bool(const std::string&)> callback;
+        };
+
+        struct File
+        {
+            size_t watchers = 0;
+            std::filesystem::file_time_type write_time;
+            // inotify watch of the directory, -1 when the file is polled
+            int descriptor = -1;
+        };
+
+        // Only touched by the thread that watches and dispatches
+        std::unordered_map<WatchId, Watch> watches;
+        WatchId next_id = 1;
+
+        // Shared with the background thread
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::thread thread;
+        bool stopping = false;
+        std::unordered_map<std::string, File> files;
+        std::unordered_set<std::string> pending;
+        std::atomic<bool> has_pending{false};
+
+        // Only touched by the background thread
+        std::vector<std::string> poll_keys;
+        std::vector<std::filesystem::file_time_type> poll_times;
+
+#ifdef __linux__
+        struct Directory
+        {
+            std::string path;
+            size_t files = 0;
+        };
+
+        int inotify_fd = -1;
+        std::unordered_map<int, Directory> directories;
+#endif
+
+        FileWatcher() = default;
+
+        // Absolute and normalized, so different spellings of a path match
+        // each other and the names inotify reports
+        static std::string makeKey(const std::string& path)
+        {
+            std::error_code error;
+            std::filesystem::path absolute = std::filesystem::absolute(path, error);
+            return (error ? std::filesystem::path(path) : absolute).lexically_normal().string();
+        }
+
+        static std::filesystem::file_time_type writeTime(const std::string& key)
+        {
+            std::error_code error;
+            std::filesystem::file_time_type time = std::filesystem::last_write_time(key, error);
+            return error ? std::filesystem::file_time_type::min() : time;
+        }
+
+        WatchId add(const std::string& path, std::function<bool(const std::string&)> callback)
+        {
+            start();
+            std::string key = makeKey(path);
+            WatchId id = next_id++;
+            watches[id] = {path, key, std::move(callback)};
+
+            std::lock_guard<std::mutex> lock(mutex);
+            File& file = files[key];
+            if (file.watchers++ == 0)
+            {
+                file.write_time = writeTime(key);
+                file.descriptor = watchDirectory(key);
+            }
+            return id;
+        }
+
+        void start()
+        {
+            if (thread.joinable())
+                return;
+#ifdef __linux__
+            inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (inotify_fd >= 0)
+            {
+                thread = std::thread(&FileWatcher::readEvents, this);
+                return;
+            }
+            std::cerr << "FileWatcher: inotify not available, polling instead" << std::endl;
+#endif
+            thread = std::thread(&FileWatcher::pollFiles, this);
+        }
+
+        // Called with the mutex held. Returns the descriptor of the
+        // directory of the file, -1 when the file has to be polled.
+        int watchDirectory(const std::string& key)
+        {
+#ifdef __linux__
+            if (inotify_fd < 0)
+                return -1;
+            std::string path = std::filesystem::path(key).parent_path().string();
+            // Adding a directory twice returns the same descriptor
+            int descriptor = inotify_add_watch(inotify_fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (descriptor < 0)
+            {
+                std::cerr << "FileWatcher: cannot watch " << path << ", polling " << key << std::endl;
+                return -1;
+            }
+            Directory& directory = directories[descriptor];
+            directory.path = path;
+            directory.files++;
+            return descriptor;
+#else
+            (void)key;
+            return -1;
+#endif
+        }
+
+        // Called with the mutex held, when the last watched file of the
+        // directory goes away
+        void unwatchDirectory(int descriptor)
+        {
+#ifdef __linux__
+            auto directory = directories.find(descriptor);
+            if (directory == directories.end() || --directory->second.files > 0)
+                return;
+            inotify_rm_watch(inotify_fd, descriptor);
+            directories.erase(directory);
+#else
+            (void)descriptor;
+#endif
+        }
+
+        // Called with the mutex held
+        void markChanged(const std::string& key)
+        {
+            pending.insert(key);
+            has_pending.store(true, std::memory_order_release);
+        }
+
+#ifdef __linux__
+        void readEvents()
+        {
+            alignas(inotify_event) char buffer[4096];
+            pollfd descriptor{inotify_fd, POLLIN, 0};
+            std::chrono::steady_clock::time_point last_poll = std::chrono::steady_clock::now();
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (stopping)
+                        return;
+                    // Files inotify does not cover
+                    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                    if (now - last_poll >= POLL_INTERVAL)
+                    {
+                        last_poll = now;
+                        checkWriteTimes(lock);
+                    }
+                }
+                // Wakes up now and then to notice stopping
+                if (poll(&descriptor, 1, 100) <= 0)
+                    continue;
+
+                ssize_t length;
+                while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (ssize_t offset = 0; offset < length;)
+                    {
+                        const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                        offset += sizeof(inotify_event) + event->len;
+
+                        auto directory = directories.find(event->wd);
+                        if (directory == directories.end())
+                            continue;
+                        if (event->mask & IN_IGNORED)
+                        {
+                            // The directory was deleted, poll its files until it is back
+                            forgetDirectory(event->wd);
+                            continue;
+                        }
+                        if (event->len == 0)
+                            continue;
+                        std::string key = (std::filesystem::path(directory->second.path) / event->name).string();
+                        if (files.count(key))
+                            markChanged(key);
+                    }
+                }
+            }
+        }
+
+        // Called with the mutex held
+        void forgetDirectory(int descriptor)
+        {
+            directories.erase(descriptor);
+            for (auto& [key, file] : files)
+            {
+                if (file.descriptor != descriptor)
+                    continue;
+                file.descriptor = -1;
+                file.write_time = std::filesystem::file_time_type::min();
+            }
+        }
+#endif
+
+        void pollFiles()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!wake.wait_for(lock, POLL_INTERVAL, [this] { return stopping; }))
+                checkWriteTimes(lock);
+        }
+
+        // Compares the write times of the files without a directory watch.
+        // Called with the mutex held, which is released while stat'ing.
+        void checkWriteTimes(std::unique_lock<std::mutex>& lock)
+        {
+            poll_keys.clear();
+            for (const auto& [key, file] : files)
+            {
+                if (file.descriptor < 0)
+                    poll_keys.push_back(key);
+            }
+            if (poll_keys.empty())
+                return;
+
+            lock.unlock();
+            poll_times.clear();
+            for (const std::string& key : poll_keys)
+                poll_times.push_back(writeTime(key));
+            lock.lock();
+
+            for (size_t i = 0; i < poll_keys.size(); i++)
+            {
+                auto file = files.find(poll_keys[i]);
+                if (file == files.end() || file->second.descriptor >= 0 || file->second.write_time == poll_times[i])
+                    continue;
+                file->second.write_time = poll_times[i];
+                markChanged(poll_keys[i]);
+            }
+        }
+    };
+}
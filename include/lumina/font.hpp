@@ -1,13 +1,22 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <GL/glew.h>
+#include <iostream>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "../libs/stb/stb_truetype.h"
 #include "../libs/glm/glm.hpp"
 
 #include "defines.hpp"
+#include "gl_state.hpp"
+#include "glyph_atlas.hpp"
+#include "ring_buffer.hpp"
 #include "shader.hpp"
 
 #include "lumina/lumina.hpp"
@@ -20,135 +29,377 @@ namespace lumina
         glm::vec2 tex_coords;
     };
 
+    // Next code point of a UTF-8 string, advances text past it. Malformed
+    // sequences give U+FFFD and skip one byte.
+    inline uint32_t nextCodepoint(const char*& text)
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text);
+        uint32_t codepoint = bytes[0];
+        int length = 1;
+        if (codepoint >= 0xF0 && codepoint < 0xF8) { codepoint &= 0x07; length = 4; }
+        else if (codepoint >= 0xE0) { codepoint &= 0x0F; length = 3; }
+        else if (codepoint >= 0xC0) { codepoint &= 0x1F; length = 2; }
+        else if (codepoint >= 0x80) { text++; return 0xFFFD; }
+
+        for (int i = 1; i < length; i++)
+        {
+            if ((bytes[i] & 0xC0) != 0x80)
+            {
+                text++;
+                return 0xFFFD;
+            }
+            codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+        }
+        text += length;
+        return codepoint;
+    }
+
+    // Bitmap rasterizes every size of a glyph on its own. SDF stores one
+    // signed distance field per glyph and scales it to every size; it needs
+    // shaders/font_sdf_fragment.glsl.
+    enum class FontMode : uint8_t
+    {
+        Bitmap,
+        SDF
+    };
+
+    // Outline and drop shadow of SDF text, drawn by the SDF shader from the
+    // same field. Distances are in pixels of the field, see SDF_SIZE; the
+    // outline plus the shadow's offset and softness should stay within
+    // SDF_PADDING.
+    struct TextEffects
+    {
+        glm::vec4 outline_color = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        float outline_width = 0.0f;
+        glm::vec4 shadow_color = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+        glm::vec2 shadow_offset = glm::vec2(0.0f);
+        float shadow_softness = 0.0f;
+    };
+
+    // Text from one TrueType font at any number of pixel sizes. Glyphs are
+    // rasterized the first time a code point is used (at a size, in bitmap
+    // mode) and packed into a GlyphAtlas shared by all sizes.
     class Font
     {
         public:
+        // Pixel size the distance fields are rasterized at, and the distance
+        // in pixels they reach beyond the outline
+        static constexpr float SDF_SIZE = 48.0f;
+        static constexpr int SDF_PADDING = 8;
+
         std::shared_ptr<Shader> shader_ptr;
 
         ~Font()
         {
-            if (font_vertex_buffer_data)
+            GLState::shared().forgetVertexArray(font_vao);
+            glDeleteVertexArrays(1, &font_vao);
+        }
+
+        Font(const char *filename, std::shared_ptr<Shader> shader_ptr, float pixel_size = 48.0f,
+             FontMode mode = FontMode::Bitmap)
+        : shader_ptr(shader_ptr), pixel_size(pixel_size), mode(mode)
+        {
+            FILE* file = fopen(filename, "rb");
+            if (!file)
+            {
+                std::cerr << "Font not found: " << filename << std::endl;
+            }
+            else
             {
-                delete[] font_vertex_buffer_data;
-                // other buffers should also be deleted
+                fseek(file, 0, SEEK_END);
+                long length = ftell(file);
+                ttf_data.resize(length > 0 ? length : 0);
+                rewind(file);
+                ttf_data.resize(fread(ttf_data.data(), 1, ttf_data.size(), file));
+                fclose(file);
             }
+            loaded = !ttf_data.empty() && stbtt_InitFont(&font_info, ttf_data.data(), stbtt_GetFontOffsetForIndex(ttf_data.data(), 0));
+            if (file && !loaded)
+                std::cerr << "Font could not be read: " << filename << std::endl;
+
+            // Text vertices are streamed, room for a few thousand glyphs per segment
+            vertex_ring = std::make_unique<RingBuffer>(GL_ARRAY_BUFFER, sizeof(FontVertex) * 6 * 4096);
+            glGenVertexArrays(1, &font_vao);
+            bindVertexBuffer();
         }
-        Font(const char *filename, std::shared_ptr<Shader> shader_ptr)
-        : shader_ptr(shader_ptr)
-        {
-            uint8 ttfBuffer[1 << 20];
-            uint8 tmpBitmap[512 * 512];
 
-            fread(ttfBuffer, 1, 1 << 20, fopen(filename, "rb"));
+        Font(const Font&) = delete;
+        Font& operator=(const Font&) = delete;
 
-            stbtt_BakeFontBitmap(ttfBuffer, 0, 48.0f, tmpBitmap, 512, 512, 32, 96, cdata);
+        // Size used when none is passed, the height from ascender to descender
+        void setPixelSize(float size) { pixel_size = size; }
+        float getPixelSize() const { return pixel_size; }
 
-            glGenTextures(1, &font_texture);
-            glBindTexture(GL_TEXTURE_2D, font_texture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 512, 512, 0, GL_RED, GL_UNSIGNED_BYTE, tmpBitmap);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glBindTexture(GL_TEXTURE_2D, 0);
+        const GlyphAtlas& getAtlas() const { return atlas; }
+        FontMode getMode() const { return mode; }
 
-            glGenVertexArrays(1, &font_vao);
-            glBindVertexArray(font_vao);
-            glGenBuffers(1, &font_vertex_buffer_id);
-            glBindBuffer(GL_ARRAY_BUFFER, font_vertex_buffer_id);
-            font_vertex_buffer_capacity = 20;
-            font_vertex_buffer_data = new FontVertex[font_vertex_buffer_capacity * 6];
-            glBufferData(GL_ARRAY_BUFFER, sizeof(FontVertex) * 6 * font_vertex_buffer_capacity, 0, GL_DYNAMIC_DRAW);
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(FontVertex), 0);
-            glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(FontVertex), (const void *)offsetof(FontVertex, tex_coords));
-            glBindVertexArray(0);
-        }
+        // Only drawn in SDF mode
+        void setEffects(const TextEffects& new_effects) { effects = new_effects; }
+        const TextEffects& getEffects() const { return effects; }
 
         glm::vec2 measureString(const char* text)
         {
-            float x = 0.0f, y = 0.0f;
-            glm::vec2 size(0.0f, 0.0f);
+            return measureString(text, pixel_size);
+        }
+
+        glm::vec2 measureString(const char* text, float size)
+        {
+            float x = 0.0f;
+            glm::vec2 extent(0.0f, 0.0f);
             while (*text)
             {
-                if (*text >= 32 && *text < 128)
-                {
-                    stbtt_aligned_quad q;
-                    stbtt_GetBakedQuad(cdata, 512, 512, *text - 32, &x, &y, &q, 1);
-                    size.x = x;
-                    size.y = std::max(size.y, q.y1 - q.y0);
-                }
-                ++text;
+                uint32_t codepoint = nextCodepoint(text);
+                if (codepoint < 32)
+                    continue;
+                const Glyph& glyph = getGlyph(codepoint, size);
+                x += glyph.advance * scaleFor(size);
+                extent.x = x;
+                extent.y = std::max(extent.y, glyph.height * scaleFor(size));
             }
-            return size;
+            return extent;
         }
 
         glm::vec2 drawString(float x, float y, const char *text, glm::vec4 text_color)
         {
-            glBindVertexArray(font_vao);
-            glBindBuffer(GL_ARRAY_BUFFER, font_vertex_buffer_id);
+            return drawString(x, y, text, text_color, pixel_size);
+        }
 
-            uint32 len = strlen(text);
-            if (font_vertex_buffer_capacity < len)
+        // y is the baseline. Returns the top right corner of the last glyph.
+        glm::vec2 drawString(float x, float y, const char *text, glm::vec4 text_color, float size)
+        {
+            // Every glyph is in the atlas before anything is uploaded
+            line.clear();
+            while (*text)
             {
-                font_vertex_buffer_capacity = len;
-                glBufferData(GL_ARRAY_BUFFER, sizeof(FontVertex) * 6 * font_vertex_buffer_capacity, 0, GL_DYNAMIC_DRAW);
-                delete[] font_vertex_buffer_data;
-                font_vertex_buffer_data = new FontVertex[font_vertex_buffer_capacity * 6];
+                uint32_t codepoint = nextCodepoint(text);
+                if (codepoint >= 32)
+                    line.push_back(&getGlyph(codepoint, size));
             }
+            if (line.empty())
+                return glm::vec2(0.0f, 0.0f);
+            atlas.flush();
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, font_texture);
-            glUniform1i(glGetUniformLocation(shader_ptr->shader_id, "u_texture"), 0);
-            glUniform4f(glGetUniformLocation(shader_ptr->shader_id, "u_color"), text_color.r, text_color.g, text_color.b, text_color.a);
+            RingBuffer::Allocation allocation = vertex_ring->allocate(sizeof(FontVertex) * 6 * line.size(), sizeof(FontVertex));
+            // Growing the ring replaces the buffer the VAO points at
+            if (vertex_ring->getBuffer() != font_vertex_buffer_id)
+                bindVertexBuffer();
+            GLState::shared().bindVertexArray(font_vao);
+            glUniform1i(shader_ptr->getUniformLocation(BuiltinUniform::UTexture), 0);
+            glUniform4f(shader_ptr->getUniformLocation(BuiltinUniform::UColor), text_color.r, text_color.g, text_color.b, text_color.a);
+            if (mode == FontMode::SDF)
+                applyEffects();
 
-            FontVertex *vData = font_vertex_buffer_data;
+            const float scale = scaleFor(size);
+            FontVertex *vData = static_cast<FontVertex*>(allocation.data);
+            const GLint first = static_cast<GLint>(allocation.offset / sizeof(FontVertex));
             uint32 numVertices = 0;
+            uint32 runStart = 0;
+            uint32_t runPage = line.front()->region.page;
 
             glm::vec2 sumWidth(0.0f, 0.0f);
 
-            while (*text)
+            for (const Glyph* glyph : line)
             {
-                if (*text >= 32 && *text < 128)
+                float x0 = x + glyph->offset_x * scale;
+                float y0 = y + glyph->offset_y * scale;
+                // Bitmaps are pixel aligned like stbtt_GetBakedQuad
+                if (mode == FontMode::Bitmap)
                 {
-                    stbtt_aligned_quad q;
-                    stbtt_GetBakedQuad(cdata, 512, 512, *text - 32, &x, &y, &q, 1);
-
-                    // Extracting the width and height
-                    // float charWidth = q.x1 - q.x0;
-                    // float charHeight = q.y1 - q.y0;
-
-                    sumWidth = glm::vec2(q.x1, q.y0);
-
-                    vData[0].position = glm::vec2(q.x0, q.y0);
-                    vData[0].tex_coords = glm::vec2(q.s0, q.t0);
-                    vData[1].position = glm::vec2(q.x1, q.y0);
-                    vData[1].tex_coords = glm::vec2(q.s1, q.t0);
-                    vData[2].position = glm::vec2(q.x1, q.y1);
-                    vData[2].tex_coords = glm::vec2(q.s1, q.t1);
-                    vData[3].position = glm::vec2(q.x0, q.y1);
-                    vData[3].tex_coords = glm::vec2(q.s0, q.t1);
-                    vData[4].position = glm::vec2(q.x0, q.y0);
-                    vData[4].tex_coords = glm::vec2(q.s0, q.t0);
-                    vData[5].position = glm::vec2(q.x1, q.y1);
-                    vData[5].tex_coords = glm::vec2(q.s1, q.t1);
-                    vData += 6;
-                    numVertices += 6;
+                    x0 = std::floor(x0 + 0.5f);
+                    y0 = std::floor(y0 + 0.5f);
                 }
-                ++text;
+                float x1 = x0 + glyph->region.width * scale;
+                float y1 = y0 + glyph->region.height * scale;
+                x += glyph->advance * scale;
+
+                sumWidth = glm::vec2(x1, y0);
+                // Spaces have no pixels and no page
+                if (glyph->region.width == 0 || glyph->region.height == 0)
+                    continue;
+
+                // Glyphs on another atlas page need a draw of their own
+                if (glyph->region.page != runPage && numVertices > runStart)
+                {
+                    drawRun(runPage, first + runStart, numVertices - runStart);
+                    runStart = numVertices;
+                }
+                runPage = glyph->region.page;
+
+                vData[0].position = glm::vec2(x0, y0);
+                vData[0].tex_coords = glm::vec2(glyph->s0, glyph->t0);
+                vData[1].position = glm::vec2(x1, y0);
+                vData[1].tex_coords = glm::vec2(glyph->s1, glyph->t0);
+                vData[2].position = glm::vec2(x1, y1);
+                vData[2].tex_coords = glm::vec2(glyph->s1, glyph->t1);
+                vData[3].position = glm::vec2(x0, y1);
+                vData[3].tex_coords = glm::vec2(glyph->s0, glyph->t1);
+                vData[4].position = glm::vec2(x0, y0);
+                vData[4].tex_coords = glm::vec2(glyph->s0, glyph->t0);
+                vData[5].position = glm::vec2(x1, y1);
+                vData[5].tex_coords = glm::vec2(glyph->s1, glyph->t1);
+                vData += 6;
+                numVertices += 6;
             }
 
-            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(FontVertex) * numVertices, font_vertex_buffer_data);
-            glDrawArrays(GL_TRIANGLES, 0, numVertices);
+            vertex_ring->flush();
+            drawRun(runPage, first + runStart, numVertices - runStart);
+            vertex_ring->fence();
 
             return sumWidth;
         }
 
         private:
-        stbtt_bakedchar cdata[96];
-        GLuint font_texture;
+        struct Glyph
+        {
+            GlyphAtlas::Region region;
+            float s0, t0, s1, t1;
+            // From the pen position on the baseline to the top left corner
+            float offset_x, offset_y;
+            float advance;
+            // Of the outline, without the padding of a distance field
+            float height;
+        };
+
+        // 128 on the outline, falling to 0 at SDF_PADDING pixels outside
+        static constexpr unsigned char SDF_ON_EDGE = 128;
+        static constexpr float SDF_PER_PIXEL = 128.0f / SDF_PADDING;
+
+        std::vector<unsigned char> ttf_data;
+        stbtt_fontinfo font_info;
+        bool loaded = false;
+        float pixel_size;
+        FontMode mode;
+        TextEffects effects;
+        GlyphAtlas atlas;
+        // Keyed by code point and size, see glyphKey()
+        std::unordered_map<uint64_t, Glyph> glyphs;
+        std::vector<const Glyph*> line;
         GLuint font_vao;
-        GLuint font_vertex_buffer_id;
-        FontVertex *font_vertex_buffer_data = 0;
-        uint32 font_vertex_buffer_capacity;
+        GLuint font_vertex_buffer_id = 0;
+        std::unique_ptr<RingBuffer> vertex_ring;
+
+        static uint64_t glyphKey(uint32_t codepoint, float size)
+        {
+            // Sizes are told apart to 1/64 pixel
+            return (static_cast<uint64_t>(std::lround(size * 64.0f)) << 32) | codepoint;
+        }
+
+        // Glyph metrics are stored at the size they were rasterized at
+        float scaleFor(float size) const
+        {
+            return mode == FontMode::SDF ? size / SDF_SIZE : 1.0f;
+        }
+
+        const Glyph& getGlyph(uint32_t codepoint, float size)
+        {
+            // One field serves every size
+            if (mode == FontMode::SDF)
+                size = SDF_SIZE;
+            auto it = glyphs.find(glyphKey(codepoint, size));
+            if (it != glyphs.end())
+                return it->second;
+
+            Glyph& glyph = glyphs[glyphKey(codepoint, size)];
+            glyph = Glyph();
+            if (!loaded)
+                return glyph;
+
+            // Missing code points show the font's .notdef glyph
+            int index = stbtt_FindGlyphIndex(&font_info, static_cast<int>(codepoint));
+            float scale = stbtt_ScaleForPixelHeight(&font_info, size);
+            int advance, left_bearing;
+            stbtt_GetGlyphHMetrics(&font_info, index, &advance, &left_bearing);
+            glyph.advance = advance * scale;
+
+            int x0, y0, x1, y1;
+            stbtt_GetGlyphBitmapBox(&font_info, index, scale, scale, &x0, &y0, &x1, &y1);
+            glyph.offset_x = static_cast<float>(x0);
+            glyph.offset_y = static_cast<float>(y0);
+            glyph.height = static_cast<float>(y1 - y0);
+            bool rasterized = mode == FontMode::SDF ? rasterizeField(glyph, index, scale)
+                                                    : rasterizeBitmap(glyph, index, scale, x1 - x0, y1 - y0);
+            if (!rasterized)
+            {
+                std::cerr << "Font: glyph " << codepoint << " does not fit the atlas at size " << size << std::endl;
+                glyph.region = GlyphAtlas::Region();
+                return glyph;
+            }
+
+            float texel = 1.0f / atlas.getPageSize();
+            glyph.s0 = glyph.region.x * texel;
+            glyph.t0 = glyph.region.y * texel;
+            glyph.s1 = (glyph.region.x + glyph.region.width) * texel;
+            glyph.t1 = (glyph.region.y + glyph.region.height) * texel;
+            return glyph;
+        }
+
+        bool rasterizeBitmap(Glyph& glyph, int index, float scale, int width, int height)
+        {
+            if (!atlas.allocate(width, height, glyph.region))
+                return false;
+            if (width > 0 && height > 0)
+            {
+                stbtt_MakeGlyphBitmap(&font_info, atlas.getPixels(glyph.region), width, height,
+                                      atlas.getStride(), scale, scale, index);
+                atlas.markDirty(glyph.region);
+            }
+            return true;
+        }
+
+        bool rasterizeField(Glyph& glyph, int index, float scale)
+        {
+            int width = 0, height = 0, offset_x = 0, offset_y = 0;
+            unsigned char* field = stbtt_GetGlyphSDF(&font_info, scale, index, SDF_PADDING, SDF_ON_EDGE, SDF_PER_PIXEL,
+                                                     &width, &height, &offset_x, &offset_y);
+            // Glyphs without an outline, like spaces, have no field
+            if (!field)
+                return atlas.allocate(0, 0, glyph.region);
+
+            bool allocated = atlas.allocate(width, height, glyph.region);
+            if (allocated)
+            {
+                uint8_t* target = atlas.getPixels(glyph.region);
+                for (int row = 0; row < height; row++)
+                    std::memcpy(target + static_cast<size_t>(row) * atlas.getStride(), field + static_cast<size_t>(row) * width, width);
+                atlas.markDirty(glyph.region);
+                glyph.offset_x = static_cast<float>(offset_x);
+                glyph.offset_y = static_cast<float>(offset_y);
+            }
+            stbtt_FreeSDF(field, nullptr);
+            return allocated;
+        }
+
+        // Turns pixels of the field into the field units the shader compares
+        void applyEffects()
+        {
+            const float units = SDF_PER_PIXEL / 255.0f;
+            const float texel = 1.0f / atlas.getPageSize();
+            shader_ptr->setUniform("u_outline_color"_u, effects.outline_color);
+            shader_ptr->setUniform("u_outline_width"_u, effects.outline_width * units);
+            shader_ptr->setUniform("u_shadow_color"_u, effects.shadow_color);
+            shader_ptr->setUniform("u_shadow_offset"_u, effects.shadow_offset * texel);
+            shader_ptr->setUniform("u_shadow_softness"_u, effects.shadow_softness * units);
+        }
+
+        void drawRun(uint32_t page, GLint first, uint32 count)
+        {
+            if (count == 0)
+                return;
+            GLState::shared().bindTexture(0, GL_TEXTURE_2D, atlas.getTexture(page));
+            glDrawArrays(GL_TRIANGLES, first, count);
+        }
+
+        void bindVertexBuffer()
+        {
+            font_vertex_buffer_id = vertex_ring->getBuffer();
+            GLState::shared().bindVertexArray(font_vao);
+            GLState::shared().bindBuffer(GL_ARRAY_BUFFER, font_vertex_buffer_id);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(FontVertex), 0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(FontVertex), (const void *)offsetof(FontVertex, tex_coords));
+            GLState::shared().bindVertexArray(0);
+        }
     };
 }
 
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
+#include "shader.hpp"
+
+namespace lumina
+{
+    // Contents of the Frame uniform block, std140 layout. Shaders declare it
+    // as
+    //
+    //   layout (std140) uniform Frame
+    //   {
+    //       mat4 view;
+    //       mat4 projection;
+    //       mat4 view_projection;
+    //       vec4 camera_position;
+    //       vec2 viewport_size;
+    //       float time;
+    //       float delta_time;
+    //   };
+    //
+    // and Shader binds it to Shader::FRAME_BINDING when linking.
+    struct FrameData
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 view_projection;
+        glm::vec4 camera_position;  // w is 1
+        glm::vec2 viewport_size;    // in pixels
+        float time;                 // in seconds
+        float delta_time;
+    };
+    static_assert(sizeof(FrameData) == 224, "FrameData must match the std140 layout of the Frame block");
+
+    // Writes the Frame block of the current camera into a streaming uniform
+    // buffer and binds it at Shader::FRAME_BINDING, where every program that
+    // declares the block reads it. The block is only written again when the
+    // camera, its matrices, the time or the viewport changed. The time is
+    // set once per frame by Viewport::swapBuffers().
+    class FrameUniforms
+    {
+    public:
+        // One instance for all programs, since they share the binding point
+        static FrameUniforms& shared()
+        {
+            static FrameUniforms frame_uniforms;
+            return frame_uniforms;
+        }
+
+        void setTime(float time, float delta_time)
+        {
+            this->time = time;
+            this->delta_time = delta_time;
+        }
+
+        // Without a size set the viewport tracked by GLState is used
+        void setViewportSize(float width, float height)
+        {
+            viewport_size = glm::vec2(width, height);
+            viewport_set = true;
+        }
+
+        // Makes the matrices of the camera visible to all programs
+        void bindCamera(Camera& camera)
+        {
+            bindCamera(&camera, camera.getViewMatrix(), camera.getProjectionMatrix());
+        }
+
+        // Same, with matrices the caller already computed for the camera
+        void bindCamera(const Camera* camera, const glm::mat4& view, const glm::mat4& projection)
+        {
+            FrameData next;
+            next.view = view;
+            next.projection = projection;
+            next.view_projection = projection * view;
+            next.camera_position = glm::inverse(view)[3];
+            next.viewport_size = viewport_size;
+            if (!viewport_set)
+            {
+                GLsizei width = 0;
+                GLsizei height = 0;
+                GLState::shared().getViewportSize(width, height);
+                next.viewport_size = glm::vec2(width, height);
+            }
+            next.time = time;
+            next.delta_time = delta_time;
+
+            if (bound && camera == bound_camera && std::memcmp(&next, &data, sizeof(FrameData)) == 0)
+                return;
+
+            data = next;
+            bound_camera = camera;
+            upload();
+        }
+
+        // Call after issuing the draws that read the bound block
+        void fence()
+        {
+            if (ring)
+                ring->fence();
+        }
+
+        // Contents of the block bound last
+        const FrameData& getData() const { return data; }
+
+        // Number of times the block was written, for profiling
+        size_t getUploadCount() const { return upload_count; }
+
+    private:
+        static constexpr size_t SEGMENT_SIZE = 64 * 1024;
+
+        FrameData data = {};
+        float time = 0.0f;
+        float delta_time = 0.0f;
+        glm::vec2 viewport_size = glm::vec2(0.0f);
+        bool viewport_set = false;
+        bool bound = false;
+        const Camera* bound_camera = nullptr;
+        size_t upload_count = 0;
+        std::unique_ptr<RingBuffer> ring;
+        size_t alignment = 256;
+
+        FrameUniforms() = default;
+
+        void upload()
+        {
+            // Created on first use, when a context is current
+            if (!ring)
+            {
+                ring = std::make_unique<RingBuffer>(GL_UNIFORM_BUFFER, SEGMENT_SIZE);
+                alignment = RingBuffer::uniformAlignment();
+            }
+
+            RingBuffer::Allocation allocation = ring->allocate(sizeof(FrameData), alignment);
+            std::memcpy(allocation.data, &data, sizeof(FrameData));
+            ring->flush();
+            GLState::shared().bindBufferRange(GL_UNIFORM_BUFFER, Shader::FRAME_BINDING, ring->getBuffer(), allocation.offset, sizeof(FrameData));
+            bound = true;
+            upload_count++;
+        }
+    };
+}
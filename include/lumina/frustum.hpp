@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define LUMINA_FRUSTUM_SSE
+#endif
+
+#include "bounds.hpp"
+
+namespace lumina
+{
+    // View frustum as six inward facing planes (xyz = normal, w = distance)
+    struct Frustum
+    {
+        enum Plane { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+        glm::vec4 planes[PlaneCount];
+
+        // Gribb/Hartmann plane extraction. Passing projection * view gives
+        // world space planes, projection * view * model object space ones.
+        static Frustum fromMatrix(const glm::mat4& m)
+        {
+            glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+            glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+            glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+            glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+            Frustum frustum;
+            frustum.planes[Left] = row3 + row0;
+            frustum.planes[Right] = row3 - row0;
+            frustum.planes[Bottom] = row3 + row1;
+            frustum.planes[Top] = row3 - row1;
+            frustum.planes[Near] = row3 + row2;
+            frustum.planes[Far] = row3 - row2;
+
+            for (glm::vec4& plane : frustum.planes)
+            {
+                float length = glm::length(glm::vec3(plane));
+                if (length > 0.0f)
+                    plane /= length;
+            }
+            return frustum;
+        }
+
+        bool intersectsSphere(const glm::vec3& center, float radius) const
+        {
+            for (const glm::vec4& plane : planes)
+            {
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                    return false;
+            }
+            return true;
+        }
+
+        // Positive vertex test: the box is out once its corner furthest along
+        // a plane normal is behind that plane
+        bool intersectsBox(const glm::vec3& min, const glm::vec3& max) const
+        {
+            glm::vec3 center = (min + max) * 0.5f;
+            glm::vec3 extent = (max - min) * 0.5f;
+            for (const glm::vec4& plane : planes)
+            {
+                glm::vec3 normal(plane);
+                if (glm::dot(normal, center) + plane.w < -glm::dot(glm::abs(normal), extent))
+                    return false;
+            }
+            return true;
+        }
+
+        bool intersects(const Bounds& bounds) const
+        {
+            return bounds.isEmpty() ||
+                   (intersectsSphere(bounds.center, bounds.radius) && intersectsBox(bounds.min, bounds.max));
+        }
+    };
+
+    struct CullingStats
+    {
+        size_t visible = 0;
+        size_t culled = 0;
+    };
+
+    // World space bounds in structure of arrays layout, so four of them are
+    // tested against a plane with one SSE instruction per component.
+    // Per plane a bounds is out when both its box and its sphere are behind
+    // the plane; both are conservative, so the smaller radius is used.
+    class BoundsBatch
+    {
+    public:
+        void clear()
+        {
+            center_x.clear(); center_y.clear(); center_z.clear();
+            extent_x.clear(); extent_y.clear(); extent_z.clear();
+            radius.clear();
+        }
+
+        void reserve(size_t count)
+        {
+            for (std::vector<float>* array : {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z, &radius})
+                array->reserve(count);
+        }
+
+        size_t size() const { return radius.size(); }
+
+        void add(const Bounds& bounds)
+        {
+            if (bounds.isEmpty())
+            {
+                // Never behind any plane
+                const float huge = std::numeric_limits<float>::max();
+                push(glm::vec3(0.0f), glm::vec3(huge), huge);
+                return;
+            }
+            push((bounds.min + bounds.max) * 0.5f, bounds.getExtent(), bounds.radius);
+        }
+
+        // Tests the bounds [begin, end), writes 1 (visible) or 0 into visible
+        // and counts the results into stats
+        void cull(const Frustum& frustum, size_t begin, size_t end, uint8_t* visible, CullingStats& stats) const
+        {
+            size_t i = begin;
+#ifdef LUMINA_FRUSTUM_SSE
+            const __m128 sign_mask = _mm_set1_ps(-0.0f);
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 cx = _mm_loadu_ps(&center_x[i]), cy = _mm_loadu_ps(&center_y[i]), cz = _mm_loadu_ps(&center_z[i]);
+                __m128 ex = _mm_loadu_ps(&extent_x[i]), ey = _mm_loadu_ps(&extent_y[i]), ez = _mm_loadu_ps(&extent_z[i]);
+                __m128 r = _mm_loadu_ps(&radius[i]);
+                __m128 outside = _mm_setzero_ps();
+
+                for (const glm::vec4& plane : frustum.planes)
+                {
+                    __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+                    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                                 _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+                    __m128 box_radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, nx), ex),
+                                                              _mm_mul_ps(_mm_andnot_ps(sign_mask, ny), ey)),
+                                                   _mm_mul_ps(_mm_andnot_ps(sign_mask, nz), ez));
+                    __m128 reach = _mm_add_ps(distance, _mm_min_ps(box_radius, r));
+                    outside = _mm_or_ps(outside, _mm_cmplt_ps(reach, _mm_setzero_ps()));
+                }
+
+                int mask = _mm_movemask_ps(outside);
+                for (int k = 0; k < 4; k++)
+                {
+                    uint8_t in = (mask >> k) & 1 ? 0 : 1;
+                    visible[i + k] = in;
+                    stats.visible += in;
+                    stats.culled += 1 - in;
+                }
+            }
+#endif
+            for (; i < end; i++)
+            {
+                bool inside = true;
+                for (const glm::vec4& plane : frustum.planes)
+                {
+                    float distance = plane.x * center_x[i] + plane.y * center_y[i] + plane.z * center_z[i] + plane.w;
+                    float box_radius = std::abs(plane.x) * extent_x[i] + std::abs(plane.y) * extent_y[i] +
+                                       std::abs(plane.z) * extent_z[i];
+                    if (distance + std::min(box_radius, radius[i]) < 0.0f)
+                    {
+                        inside = false;
+                        break;
+                    }
+                }
+                visible[i] = inside ? 1 : 0;
+                if (inside)
+                    stats.visible++;
+                else
+                    stats.culled++;
+            }
+        }
+
+    private:
+        std::vector<float> center_x, center_y, center_z;
+        std::vector<float> extent_x, extent_y, extent_z;
+        std::vector<float> radius;
+
+        void push(const glm::vec3& center, const glm::vec3& extent, float sphere_radius)
+        {
+            center_x.push_back(center.x);
+            center_y.push_back(center.y);
+            center_z.push_back(center.z);
+            extent_x.push_back(extent.x);
+            extent_y.push_back(extent.y);
+            extent_z.push_back(extent.z);
+            radius.push_back(sphere_radius);
+        }
+    };
+}
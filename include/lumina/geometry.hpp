@@ -1,9 +1,64 @@
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <cstring>
+
+#include "defines.hpp"
+#include "mesh.hpp"
+#include "mapped_file.hpp"
+#include "geometry_parser.hpp"
+#include "importers/obj.hpp"
+#include "importers/gltf.hpp"
 
 namespace lumina
 {
+    // Binary mesh cache (.lmesh)
+    //
+    // Layout: BinaryMeshHeader, num_attributes * BinaryMeshAttribute,
+    // num_constants * BinaryMeshConstant, the packed vertex block and the
+    // index block. Both blocks start at 16 byte aligned offsets so they can
+    // be handed to GL directly from a memory mapping.
+    constexpr char BINARY_MESH_MAGIC[4] = {'L', 'M', 'S', 'H'};
+    constexpr uint32 BINARY_MESH_VERSION = 3;
+
+    struct BinaryMeshHeader
+    {
+        char magic[4];
+        uint32 version;
+        uint32 num_vertices;
+        uint32 num_indices;
+        uint32 vertex_stride;   // bytes per vertex
+        uint32 index_size;      // bytes per index
+        uint32 num_attributes;
+        uint32 num_constants;
+        uint64 vertex_offset;
+        uint64 vertex_bytes;
+        uint64 index_offset;
+        uint64 index_bytes;
+        float position_offset[3]; // dequantization of normalized positions
+        float position_scale[3];
+        float bounds_min[3];      // object space, before dequantization
+        float bounds_max[3];
+        float bounds_center[3];
+        float bounds_radius;
+    };
+
+    struct BinaryMeshAttribute
+    {
+        uint32 location;
+        uint32 components;
+        uint32 type;
+        uint32 normalized;
+        uint32 offset;
+    };
+
+    struct BinaryMeshConstant
+    {
+        uint32 location;
+        float value[4];
+    };
+
     class GeometryLoader
     {
         public:
@@ -12,31 +67,261 @@ namespace lumina
 
         }
         
-        static std::shared_ptr<Mesh> loadGeometryFromFile(const std::string& filename)
+        // The layout applies to text and .obj files; .lmesh files keep the
+        // layout they were written with and glTF buffers are used as stored.
+        static std::shared_ptr<Mesh> loadGeometryFromFile(const std::string& filename,
+                                                          const VertexLayout& layout = VertexLayout())
+        {
+            if (isBinaryMeshFile(filename))
+            {
+                return loadBinaryGeometryFromFile(filename);
+            }
+            if (hasExtension(filename, ".obj"))
+            {
+                return importers::ObjImporter::loadFile(filename, 0, layout);
+            }
+            if (hasExtension(filename, ".gltf"))
+            {
+                auto meshes = importers::GltfImporter::loadFile(filename);
+                if (meshes.empty())
+                    return nullptr;
+                if (meshes.size() > 1)
+                    std::cerr << "Only the first of " << meshes.size() << " primitives is used from: " << filename << std::endl;
+                return meshes.front();
+            }
+
+            auto pos_ptr = std::make_shared<std::vector<float>>();
+            auto ind_ptr = std::make_shared<std::vector<unsigned int>>();
+            auto colors_ptr = std::make_shared<std::vector<float>>();
+            auto uvs_ptr = std::make_shared<std::vector<float>>();
+
+            parseFile(filename, *pos_ptr, *colors_ptr, *uvs_ptr, *ind_ptr);
+
+            if (colors_ptr->empty()) colors_ptr = nullptr;
+            if (uvs_ptr->empty()) uvs_ptr = nullptr;
+
+            auto mesh = std::make_shared<Mesh>(pos_ptr, ind_ptr, colors_ptr, uvs_ptr, nullptr, layout);
+            // Uncolored meshes keep rendering white without storing a color per vertex
+            if (!colors_ptr)
+                mesh->setConstantAttribute(1, glm::vec4(1.0f));
+            return mesh;
+        }
+
+        // Maps a .lmesh file and uploads its vertex and index blocks directly
+        // from the mapping into the mesh buffers.
+        static std::shared_ptr<Mesh> loadBinaryGeometryFromFile(const std::string& filename)
+        {
+            MappedFile file(filename);
+            if (!file.isOpen())
+            {
+                std::cerr << "Unable to open binary mesh: " << filename << std::endl;
+                return nullptr;
+            }
+
+            const BinaryMeshHeader* header = validateBinaryMesh(file.data(), file.size(), filename);
+            if (!header)
+                return nullptr;
+
+            const auto* file_attributes = reinterpret_cast<const BinaryMeshAttribute*>(file.data() + sizeof(BinaryMeshHeader));
+            const auto* file_constants = reinterpret_cast<const BinaryMeshConstant*>(file_attributes + header->num_attributes);
+
+            PackedVertexLayout layout;
+            layout.stride = static_cast<GLsizei>(header->vertex_stride);
+            layout.attributes.reserve(header->num_attributes);
+            for (uint32 i = 0; i < header->num_attributes; i++)
+            {
+                const BinaryMeshAttribute& a = file_attributes[i];
+                layout.attributes.push_back({a.location, static_cast<GLint>(a.components), a.type,
+                                             static_cast<GLboolean>(a.normalized ? GL_TRUE : GL_FALSE), a.offset});
+            }
+            for (uint32 i = 0; i < header->num_constants; i++)
+            {
+                const BinaryMeshConstant& c = file_constants[i];
+                layout.constants.push_back({c.location, glm::vec4(c.value[0], c.value[1], c.value[2], c.value[3])});
+            }
+            layout.position_offset = glm::vec3(header->position_offset[0], header->position_offset[1], header->position_offset[2]);
+            layout.position_scale = glm::vec3(header->position_scale[0], header->position_scale[1], header->position_scale[2]);
+
+            GLenum index_type = header->index_size == 1 ? GL_UNSIGNED_BYTE :
+                                header->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            auto mesh = std::make_shared<Mesh>(file.data() + header->vertex_offset, header->num_vertices, layout,
+                                               file.data() + header->index_offset, header->num_indices, index_type);
+            Bounds bounds;
+            if (header->num_vertices > 0)
+            {
+                bounds.min = glm::vec3(header->bounds_min[0], header->bounds_min[1], header->bounds_min[2]);
+                bounds.max = glm::vec3(header->bounds_max[0], header->bounds_max[1], header->bounds_max[2]);
+                bounds.center = glm::vec3(header->bounds_center[0], header->bounds_center[1], header->bounds_center[2]);
+                bounds.radius = header->bounds_radius;
+            }
+            mesh->setBounds(bounds);
+            return mesh;
+        }
+
+        // Converts a mesh in the #positions/#uvs/#indices text format into the
+        // binary .lmesh format, optionally running the mesh optimizer first.
+        static bool convertToBinary(const std::string& text_filename, const std::string& binary_filename,
+                                    bool optimize = true, const VertexLayout& layout = VertexLayout())
         {
             std::vector<float> positions;
             std::vector<float> colors;
             std::vector<float> uvs;
             std::vector<unsigned int> indices;
 
-            parseFile(filename, positions, colors, uvs, indices);
+            parseFile(text_filename, positions, colors, uvs, indices);
+            if (positions.empty())
+            {
+                std::cerr << "No geometry found in: " << text_filename << std::endl;
+                return false;
+            }
 
-            auto pos_ptr = std::make_shared<std::vector<float>>(positions);
-            auto ind_ptr = std::make_shared<std::vector<unsigned int>>(indices);
-            std::shared_ptr<std::vector<float>> colors_ptr = colors.empty() ? nullptr : std::make_shared<std::vector<float>>(colors);
-            std::shared_ptr<std::vector<float>> uvs_ptr = uvs.empty() ? nullptr : std::make_shared<std::vector<float>>(uvs);
+            if (optimize)
+            {
+                MeshOptimizer::optimize(positions, &colors, &uvs, nullptr, indices);
+            }
 
-            return std::make_shared<Mesh>(pos_ptr, ind_ptr, colors_ptr, uvs_ptr);
+            // Text meshes without colors render white, see loadGeometryFromFile
+            if (colors.empty())
+                colors.assign(positions.size(), 1.0f);
+
+            return writeBinaryGeometry(binary_filename, positions, &colors,
+                                       uvs.empty() ? nullptr : &uvs, indices, nullptr, layout);
+        }
+
+        static bool writeBinaryGeometry(const std::string& filename,
+                                        const std::vector<float>& positions,
+                                        const std::vector<float>* colors,
+                                        const std::vector<float>* uvs,
+                                        const std::vector<unsigned int>& indices,
+                                        const std::vector<float>* normals = nullptr,
+                                        const VertexLayout& layout = VertexLayout())
+        {
+            PackedVertices packed = packVertices(positions, colors, uvs, normals, layout);
+            const std::vector<VertexAttribute>& attributes = packed.layout.attributes;
+            const std::vector<ConstantAttribute>& constants = packed.layout.constants;
+
+            unsigned int max_index = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end());
+            GLenum index_type = selectIndexType(max_index, layout.byte_indices);
+            std::vector<unsigned char> packed_indices = packIndices(indices.data(), indices.size(), index_type);
+
+            BinaryMeshHeader header{};
+            std::memcpy(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic));
+            header.version = BINARY_MESH_VERSION;
+            header.num_vertices = static_cast<uint32>(positions.size() / 3);
+            header.num_indices = static_cast<uint32>(indices.size());
+            header.vertex_stride = static_cast<uint32>(packed.layout.stride);
+            header.index_size = static_cast<uint32>(indexTypeSize(index_type));
+            header.num_attributes = static_cast<uint32>(attributes.size());
+            header.num_constants = static_cast<uint32>(constants.size());
+            header.vertex_offset = alignOffset(sizeof(BinaryMeshHeader) + attributes.size() * sizeof(BinaryMeshAttribute) +
+                                               constants.size() * sizeof(BinaryMeshConstant));
+            header.vertex_bytes = packed.data.size();
+            for (int k = 0; k < 3; k++)
+            {
+                header.position_offset[k] = packed.layout.position_offset[k];
+                header.position_scale[k] = packed.layout.position_scale[k];
+            }
+            Bounds bounds = Bounds::fromPositions(positions.data(), positions.size() / 3);
+            for (int k = 0; k < 3; k++)
+            {
+                header.bounds_min[k] = bounds.min[k];
+                header.bounds_max[k] = bounds.max[k];
+                header.bounds_center[k] = bounds.center[k];
+            }
+            header.bounds_radius = bounds.radius;
+            header.index_offset = alignOffset(header.vertex_offset + header.vertex_bytes);
+            header.index_bytes = packed_indices.size();
+
+            std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                std::cerr << "Unable to write file: " << filename << std::endl;
+                return false;
+            }
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const VertexAttribute& a : attributes)
+            {
+                BinaryMeshAttribute out{a.location, static_cast<uint32>(a.components), a.type,
+                                        static_cast<uint32>(a.normalized), a.offset};
+                file.write(reinterpret_cast<const char*>(&out), sizeof(out));
+            }
+            for (const ConstantAttribute& c : constants)
+            {
+                BinaryMeshConstant out{c.location, {c.value.x, c.value.y, c.value.z, c.value.w}};
+                file.write(reinterpret_cast<const char*>(&out), sizeof(out));
+            }
+            writePadding(file, header.vertex_offset);
+            file.write(reinterpret_cast<const char*>(packed.data.data()), header.vertex_bytes);
+            writePadding(file, header.index_offset);
+            file.write(reinterpret_cast<const char*>(packed_indices.data()), header.index_bytes);
+
+            if (!file)
+            {
+                std::cerr << "Failed writing binary mesh: " << filename << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        static bool isBinaryMeshFile(const std::string& filename)
+        {
+            return hasExtension(filename, ".lmesh");
         }
 
         private:
-        enum class Section
+        static bool hasExtension(const std::string& filename, const std::string& extension)
+        {
+            return filename.size() >= extension.size() &&
+                   filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+        }
+
+        static uint64 alignOffset(uint64 offset)
         {
-            None,
-            Positions,
-            UVs,
-            Indices
-        };
+            return (offset + 15) & ~uint64(15);
+        }
+
+        static void writePadding(std::ofstream& file, uint64 target_offset)
+        {
+            static const char zeros[16] = {};
+            uint64 position = static_cast<uint64>(file.tellp());
+            if (target_offset > position)
+                file.write(zeros, static_cast<std::streamsize>(target_offset - position));
+        }
+
+        static const BinaryMeshHeader* validateBinaryMesh(const unsigned char* data, size_t size, const std::string& filename)
+        {
+            if (size < sizeof(BinaryMeshHeader))
+            {
+                std::cerr << "Binary mesh too small: " << filename << std::endl;
+                return nullptr;
+            }
+
+            const auto* header = reinterpret_cast<const BinaryMeshHeader*>(data);
+            if (std::memcmp(header->magic, BINARY_MESH_MAGIC, sizeof(header->magic)) != 0 ||
+                header->version != BINARY_MESH_VERSION)
+            {
+                std::cerr << "Unsupported binary mesh format: " << filename << std::endl;
+                return nullptr;
+            }
+
+            uint64 attributes_end = sizeof(BinaryMeshHeader) + uint64(header->num_attributes) * sizeof(BinaryMeshAttribute) +
+                                    uint64(header->num_constants) * sizeof(BinaryMeshConstant);
+            bool valid = (header->index_size == 1 || header->index_size == 2 || header->index_size == 4) &&
+                         header->vertex_stride > 0 &&
+                         attributes_end <= header->vertex_offset &&
+                         header->vertex_bytes == uint64(header->num_vertices) * header->vertex_stride &&
+                         header->index_bytes == uint64(header->num_indices) * header->index_size &&
+                         header->vertex_offset + header->vertex_bytes <= size &&
+                         header->index_offset + header->index_bytes <= size &&
+                         header->index_offset % header->index_size == 0;
+            if (!valid)
+            {
+                std::cerr << "Corrupt binary mesh: " << filename << std::endl;
+                return nullptr;
+            }
+            return header;
+        }
 
         static void parseFile(const std::string& filename,
                               std::vector<float>& positions,
@@ -44,85 +329,7 @@ namespace lumina
                               std::vector<float>& uvs,
                               std::vector<unsigned int>& indices)
         {
-            std::ifstream file(filename);
-            std::string line;
-            Section currentSection = Section::None;
-
-            if (!file.is_open())
-            {
-                std::cerr << "Unable to open file: " << filename << std::endl;
-                return;
-            }
-
-            while (std::getline(file, line))
-            {
-                // Trim and ignore empty lines
-                if (line.empty() || line[0] == '\r')
-                    continue;
-
-                if (line[0] == '#')
-                {
-                    if (line == "#positions") currentSection = Section::Positions;
-                    else if (line == "#uvs") currentSection = Section::UVs;
-                    else if (line == "#indices") currentSection = Section::Indices;
-                    else currentSection = Section::None;
-                    continue;
-                }
-
-                std::stringstream ss(line);
-                switch (currentSection)
-                {
-                    case Section::Positions: {
-                        float x, y, z, r, g, b;
-                        if (ss >> x >> y >> z)
-                        {
-                            positions.push_back(x);
-                            positions.push_back(y);
-                            positions.push_back(z);
-                            
-                            // Try to read color data (optional)
-                            if (ss >> r >> g >> b)
-                            {
-                                colors.push_back(r);
-                                colors.push_back(g);
-                                colors.push_back(b);
-                            }
-                            else
-                            {
-                                // Default to white if no color data
-                                colors.push_back(1.0f);
-                                colors.push_back(1.0f);
-                                colors.push_back(1.0f);
-                            }
-                        }
-                        break;
-                    }
-                    case Section::UVs: {
-                        float u, v;
-                        if (ss >> u >> v)
-                        {
-                            uvs.push_back(u);
-                            uvs.push_back(v);
-                        }
-                        break;
-                    }
-                    case Section::Indices: {
-                        unsigned int i1, i2, i3;
-                        if (ss >> i1 >> i2 >> i3)
-                        {
-                            indices.push_back(i1);
-                            indices.push_back(i2);
-                            indices.push_back(i3);
-                        }
-                        break;
-                    }
-                    default:
-                        std::cerr << "Unknown section or malformed line: " << line << "\n";
-                        break;
-                }
-            }
-
-            file.close();
+            GeometryParser::parseFile(filename, positions, colors, uvs, indices);
         }
     };
 }
\ No newline at end of file
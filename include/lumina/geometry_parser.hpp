@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUMINA_SSE2 1
+#endif
+
+#include "mapped_file.hpp"
+
+namespace lumina
+{
+    namespace simd
+    {
+        // Returns a pointer to the first occurrence of c in [begin, end) or end.
+        inline const char* findChar(const char* begin, const char* end, char c)
+        {
+#ifdef LUMINA_SSE2
+            const __m128i needle = _mm_set1_epi8(c);
+            while (end - begin >= 16)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+                int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+                if (mask)
+                {
+#if defined(_MSC_VER) && !defined(__clang__)
+                    unsigned long bit;
+                    _BitScanForward(&bit, mask);
+                    return begin + bit;
+#else
+                    return begin + __builtin_ctz(mask);
+#endif
+                }
+                begin += 16;
+            }
+#endif
+            while (begin < end && *begin != c)
+                ++begin;
+            return begin;
+        }
+
+        // Number of occurrences of c in [begin, end).
+        inline size_t countChar(const char* begin, const char* end, char c)
+        {
+            size_t count = 0;
+#ifdef LUMINA_SSE2
+            const __m128i needle = _mm_set1_epi8(c);
+            while (end - begin >= 16)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+                unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+#if defined(_MSC_VER) && !defined(__clang__)
+                count += __popcnt(mask);
+#else
+                count += static_cast<size_t>(__builtin_popcount(mask));
+#endif
+                begin += 16;
+            }
+#endif
+            while (begin < end)
+            {
+                count += (*begin == c);
+                ++begin;
+            }
+            return count;
+        }
+    }
+
+    namespace text
+    {
+        // Whitespace and commas separate numbers in the text formats
+        inline bool isSeparator(char c)
+        {
+            return c == ' ' || c == '\t' || c == ',' || c == '\r';
+        }
+
+        // Parses one number after skipping leading separators and advances p past it
+        template<typename T>
+        inline bool parseNumber(const char*& p, const char* end, T& value)
+        {
+            while (p < end && isSeparator(*p))
+                ++p;
+            if (p < end && *p == '+')
+                ++p;
+            if (p == end)
+                return false;
+
+#if defined(__cpp_lib_to_chars) || defined(_MSC_VER)
+            auto result = std::from_chars(p, end, value);
+            if (result.ec != std::errc())
+                return false;
+            p = result.ptr;
+            return true;
+#else
+            if constexpr (std::is_integral_v<T>)
+            {
+                auto result = std::from_chars(p, end, value);
+                if (result.ec != std::errc())
+                    return false;
+                p = result.ptr;
+                return true;
+            }
+            else
+            {
+                char token[64];
+                size_t length = 0;
+                while (p + length < end && length < sizeof(token) - 1 && !isSeparator(p[length]) && p[length] != '\n')
+                {
+                    token[length] = p[length];
+                    ++length;
+                }
+                token[length] = '\0';
+                char* token_end = nullptr;
+                value = std::strtof(token, &token_end);
+                if (token_end == token)
+                    return false;
+                p += token_end - token;
+                return true;
+            }
+#endif
+        }
+    }
+
+    // Parser for the #positions/#uvs/#indices text geometry format.
+    //
+    // The file is mapped into memory once. A counting pass locates the
+    // sections and counts their lines so every output array is sized up
+    // front, then each line is converted in place with std::from_chars.
+    // Large sections are split at line boundaries and parsed on several
+    // threads, each writing into its own slice of the output arrays.
+    class GeometryParser
+    {
+        public:
+        // num_threads == 0 picks the hardware concurrency for large files
+        static bool parseFile(const std::string& filename,
+                              std::vector<float>& positions,
+                              std::vector<float>& colors,
+                              std::vector<float>& uvs,
+                              std::vector<unsigned int>& indices,
+                              unsigned int num_threads = 0)
+        {
+            MappedFile file(filename);
+            if (!file.isOpen())
+            {
+                std::cerr << "Unable to open file: " << filename << std::endl;
+                return false;
+            }
+
+            const char* data = reinterpret_cast<const char*>(file.data());
+            parseBuffer(data, data + file.size(), positions, colors, uvs, indices, num_threads);
+            return true;
+        }
+
+        static void parseBuffer(const char* begin, const char* end,
+                                std::vector<float>& positions,
+                                std::vector<float>& colors,
+                                std::vector<float>& uvs,
+                                std::vector<unsigned int>& indices,
+                                unsigned int num_threads = 0)
+        {
+            std::vector<Chunk> chunks;
+            size_t total_lines[SECTION_COUNT] = {};
+
+            collectChunks(begin, end, chunks, total_lines, resolveThreadCount(end - begin, num_threads));
+
+            positions.assign(total_lines[POSITIONS] * 3, 0.0f);
+            colors.assign(total_lines[POSITIONS] * 3, 0.0f);
+            uvs.assign(total_lines[UVS] * 2, 0.0f);
+            indices.assign(total_lines[INDICES] * 3, 0u);
+
+            Output output{positions.data(), colors.data(), uvs.data(), indices.data()};
+
+            if (chunks.size() <= 1)
+            {
+                for (Chunk& chunk : chunks) parseChunk(chunk, output);
+            }
+            else
+            {
+                std::vector<std::thread> workers;
+                workers.reserve(chunks.size() - 1);
+                for (size_t i = 1; i < chunks.size(); i++)
+                {
+                    workers.emplace_back(parseChunk, std::ref(chunks[i]), output);
+                }
+                parseChunk(chunks[0], output);
+                for (std::thread& worker : workers) worker.join();
+            }
+
+            // Drop the slots of blank or malformed lines
+            size_t valid[SECTION_COUNT] = {};
+            size_t colored_lines = 0;
+            for (const Chunk& chunk : chunks)
+            {
+                colored_lines += chunk.colored_lines;
+                if (chunk.section == POSITIONS)
+                {
+                    compact(positions, chunk, valid[POSITIONS], 3);
+                    compact(colors, chunk, valid[POSITIONS], 3);
+                }
+                else if (chunk.section == UVS)
+                {
+                    compact(uvs, chunk, valid[UVS], 2);
+                }
+                else if (chunk.section == INDICES)
+                {
+                    compact(indices, chunk, valid[INDICES], 3);
+                }
+                valid[chunk.section] += chunk.valid_lines;
+            }
+
+            positions.resize(valid[POSITIONS] * 3);
+            // Only files that color at least one vertex get a color stream
+            colors.resize(colored_lines > 0 ? valid[POSITIONS] * 3 : 0);
+            uvs.resize(valid[UVS] * 2);
+            indices.resize(valid[INDICES] * 3);
+        }
+
+        private:
+        enum Section
+        {
+            NONE,
+            POSITIONS,
+            UVS,
+            INDICES,
+            SECTION_COUNT
+        };
+
+        struct Chunk
+        {
+            Section section;
+            const char* begin;
+            const char* end;
+            size_t first_slot;
+            size_t valid_lines = 0;
+            size_t colored_lines = 0;
+        };
+
+        struct Output
+        {
+            float* positions;
+            float* colors;
+            float* uvs;
+            unsigned int* indices;
+        };
+
+        static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+        static unsigned int resolveThreadCount(ptrdiff_t bytes, unsigned int requested)
+        {
+            if (requested > 0)
+                return requested;
+            if (bytes < static_cast<ptrdiff_t>(4 * MIN_CHUNK_BYTES))
+                return 1;
+            unsigned int hardware = std::thread::hardware_concurrency();
+            return hardware > 0 ? hardware : 1;
+        }
+
+        static Section sectionFromHeader(const char* begin, const char* end)
+        {
+            while (end > begin && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+                --end;
+            size_t length = static_cast<size_t>(end - begin);
+            auto is = [&](const char* name) {
+                return length == std::strlen(name) && std::memcmp(begin, name, length) == 0;
+            };
+            if (is("#positions")) return POSITIONS;
+            if (is("#uvs")) return UVS;
+            if (is("#indices")) return INDICES;
+            return NONE;
+        }
+
+        static size_t countLines(const char* begin, const char* end)
+        {
+            if (begin == end)
+                return 0;
+            return simd::countChar(begin, end, '\n') + (end[-1] != '\n' ? 1 : 0);
+        }
+
+        // Counting pass: splits the buffer into sections and every section
+        // into line aligned chunks, assigning each chunk its first output slot.
+        static void collectChunks(const char* begin, const char* end,
+                                  std::vector<Chunk>& chunks,
+                                  size_t (&total_lines)[SECTION_COUNT],
+                                  unsigned int num_threads)
+        {
+            Section section = NONE;
+            const char* p = begin;
+
+            while (p < end)
+            {
+                if (*p == '#')
+                {
+                    const char* line_end = simd::findChar(p, end, '\n');
+                    section = sectionFromHeader(p, line_end);
+                    p = line_end < end ? line_end + 1 : end;
+                    continue;
+                }
+
+                // The section body runs up to the next '#' at the start of a line
+                const char* body_end = p;
+                while (true)
+                {
+                    body_end = simd::findChar(body_end, end, '#');
+                    if (body_end == end || body_end[-1] == '\n')
+                        break;
+                    ++body_end;
+                }
+
+                size_t bytes = static_cast<size_t>(body_end - p);
+                size_t pieces = std::max<size_t>(1, std::min<size_t>(num_threads, bytes / MIN_CHUNK_BYTES));
+                const char* chunk_begin = p;
+                for (size_t i = 0; i < pieces; i++)
+                {
+                    const char* chunk_end = body_end;
+                    if (i + 1 < pieces)
+                    {
+                        chunk_end = simd::findChar(p + bytes * (i + 1) / pieces, body_end, '\n');
+                        if (chunk_end < body_end) ++chunk_end;
+                    }
+                    if (chunk_end <= chunk_begin)
+                        continue;
+
+                    Chunk chunk{section, chunk_begin, chunk_end, total_lines[section]};
+                    total_lines[section] += countLines(chunk_begin, chunk_end);
+                    chunks.push_back(chunk);
+                    chunk_begin = chunk_end;
+                }
+
+                p = body_end;
+            }
+        }
+
+        template<typename T, size_t N>
+        static size_t parseValues(const char* p, const char* end, T (&values)[N])
+        {
+            size_t count = 0;
+            while (count < N && text::parseNumber(p, end, values[count]))
+                ++count;
+            return count;
+        }
+
+        static void parseChunk(Chunk& chunk, Output output)
+        {
+            size_t slot = chunk.first_slot;
+            const char* p = chunk.begin;
+
+            while (p < chunk.end)
+            {
+                const char* line_end = simd::findChar(p, chunk.end, '\n');
+                const char* next = line_end < chunk.end ? line_end + 1 : chunk.end;
+
+                // Ignore empty lines
+                if (p == line_end || *p == '\r')
+                {
+                    p = next;
+                    continue;
+                }
+
+                switch (chunk.section)
+                {
+                    case POSITIONS: {
+                        float v[6];
+                        size_t count = parseValues(p, line_end, v);
+                        if (count >= 3)
+                        {
+                            float* position = output.positions + slot * 3;
+                            float* color = output.colors + slot * 3;
+                            position[0] = v[0];
+                            position[1] = v[1];
+                            position[2] = v[2];
+
+                            // Default to white if no color data
+                            bool has_color = count == 6;
+                            color[0] = has_color ? v[3] : 1.0f;
+                            color[1] = has_color ? v[4] : 1.0f;
+                            color[2] = has_color ? v[5] : 1.0f;
+                            chunk.colored_lines += has_color ? 1 : 0;
+                            ++slot;
+                        }
+                        break;
+                    }
+                    case UVS: {
+                        float v[2];
+                        if (parseValues(p, line_end, v) == 2)
+                        {
+                            output.uvs[slot * 2 + 0] = v[0];
+                            output.uvs[slot * 2 + 1] = v[1];
+                            ++slot;
+                        }
+                        break;
+                    }
+                    case INDICES: {
+                        unsigned int v[3];
+                        if (parseValues(p, line_end, v) == 3)
+                        {
+                            output.indices[slot * 3 + 0] = v[0];
+                            output.indices[slot * 3 + 1] = v[1];
+                            output.indices[slot * 3 + 2] = v[2];
+                            ++slot;
+                        }
+                        break;
+                    }
+                    default:
+                        std::cerr << "Unknown section or malformed line: " << std::string(p, line_end) << "\n";
+                        break;
+                }
+
+                p = next;
+            }
+
+            chunk.valid_lines = slot - chunk.first_slot;
+        }
+
+        template<typename T>
+        static void compact(std::vector<T>& values, const Chunk& chunk, size_t destination_line, size_t width)
+        {
+            if (destination_line == chunk.first_slot || chunk.valid_lines == 0)
+                return;
+            std::memmove(values.data() + destination_line * width,
+                         values.data() + chunk.first_slot * width,
+                         chunk.valid_lines * width * sizeof(T));
+        }
+    };
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <cstddef>
+
+#include <GL/glew.h>
+
+namespace lumina
+{
+    // Shadow copy of the GL state lumina changes most often. Every bind and
+    // state change in lumina goes through here, and calls that would set
+    // what is already set are not issued.
+    //
+    // lumina leaves programs, vertex arrays and textures bound after
+    // drawing instead of resetting them to 0. Code that changes GL state
+    // directly has to call invalidate() afterwards, so that the next call
+    // here is issued again.
+    class GLState
+    {
+    public:
+        static constexpr unsigned int TEXTURE_UNITS = 16;
+        static constexpr unsigned int UNIFORM_BINDINGS = 8;
+
+        struct Stats
+        {
+            size_t issued = 0;
+            size_t elided = 0;
+        };
+
+        // lumina renders with one context, so there is one shadow copy
+        static GLState& shared()
+        {
+            static GLState state;
+            return state;
+        }
+
+        void useProgram(GLuint program)
+        {
+            if (!changed(current_program, program))
+                return;
+            glUseProgram(program);
+        }
+
+        void bindVertexArray(GLuint vertex_array)
+        {
+            if (!changed(current_vertex_array, vertex_array))
+                return;
+            glBindVertexArray(vertex_array);
+            // The element buffer binding is part of the vertex array
+            element_buffer = UNKNOWN;
+        }
+
+        void bindBuffer(GLenum target, GLuint buffer)
+        {
+            GLuint* cached = bufferSlot(target);
+            if (cached && !changed(*cached, buffer))
+                return;
+            if (!cached)
+                stats.issued++;
+            glBindBuffer(target, buffer);
+        }
+
+        // Also sets the generic binding of the target, like GL does
+        void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+        {
+            bindBufferRange(target, index, buffer, 0, 0);
+        }
+
+        // A size of 0 binds the whole buffer
+        void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+        {
+            if (target == GL_UNIFORM_BUFFER && index < UNIFORM_BINDINGS)
+            {
+                IndexedBuffer& binding = uniform_bindings[index];
+                if (binding.buffer == buffer && binding.offset == offset && binding.size == size)
+                {
+                    stats.elided++;
+                    return;
+                }
+                binding = {buffer, offset, size};
+            }
+            stats.issued++;
+            if (size == 0)
+                glBindBufferBase(target, index, buffer);
+            else
+                glBindBufferRange(target, index, buffer, offset, size);
+            if (GLuint* cached = bufferSlot(target))
+                *cached = buffer;
+        }
+
+        // Only GL_TEXTURE_2D bindings are cached, other targets are always
+        // bound
+        void bindTexture(GLuint unit, GLenum target, GLuint texture)
+        {
+            if (target == GL_TEXTURE_2D && unit < TEXTURE_UNITS && textures[unit] == texture)
+            {
+                stats.elided++;
+                return;
+            }
+            activeTexture(unit);
+            stats.issued++;
+            glBindTexture(target, texture);
+            if (target == GL_TEXTURE_2D && unit < TEXTURE_UNITS)
+                textures[unit] = texture;
+        }
+
+        void setEnabled(GLenum capability, bool enabled)
+        {
+            int* cached = capabilitySlot(capability);
+            int value = enabled ? 1 : 0;
+            if (cached && *cached == value)
+            {
+                stats.elided++;
+                return;
+            }
+            stats.issued++;
+            if (enabled)
+                glEnable(capability);
+            else
+                glDisable(capability);
+            if (cached)
+                *cached = value;
+        }
+
+        void blendFunc(GLenum source, GLenum destination)
+        {
+            if (blend_source == source && blend_destination == destination)
+            {
+                stats.elided++;
+                return;
+            }
+            stats.issued++;
+            glBlendFunc(source, destination);
+            blend_source = source;
+            blend_destination = destination;
+        }
+
+        void depthFunc(GLenum function)
+        {
+            if (!changed(depth_function, function))
+                return;
+            glDepthFunc(function);
+        }
+
+        void depthMask(bool enabled)
+        {
+            int value = enabled ? 1 : 0;
+            if (depth_mask == value)
+            {
+                stats.elided++;
+                return;
+            }
+            stats.issued++;
+            glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+            depth_mask = value;
+        }
+
+        void scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+        {
+            if (!changed(scissor_rect, {x, y, width, height}))
+                return;
+            glScissor(x, y, width, height);
+        }
+
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+        {
+            if (!changed(viewport_rect, {x, y, width, height}))
+                return;
+            glViewport(x, y, width, height);
+        }
+
+        // Size of the current viewport, only asked from GL while unknown
+        void getViewportSize(GLsizei& width, GLsizei& height)
+        {
+            if (viewport_rect.width < 0)
+            {
+                GLint rect[4] = {};
+                glGetIntegerv(GL_VIEWPORT, rect);
+                viewport_rect = {rect[0], rect[1], rect[2], rect[3]};
+            }
+            width = viewport_rect.width;
+            height = viewport_rect.height;
+        }
+
+        // Forgets everything, the next call of each kind is issued
+        void invalidate()
+        {
+            *this = GLState(stats, last_frame);
+        }
+
+        // GL unbinds deleted objects and may hand their names out again,
+        // call these when deleting something that might be bound
+        void forgetProgram(GLuint program)
+        {
+            if (current_program == program)
+                current_program = 0;
+        }
+
+        void forgetVertexArray(GLuint vertex_array)
+        {
+            if (current_vertex_array == vertex_array)
+            {
+                current_vertex_array = 0;
+                element_buffer = UNKNOWN;
+            }
+        }
+
+        void forgetBuffer(GLuint buffer)
+        {
+            for (GLuint* cached : {&array_buffer, &element_buffer, &uniform_buffer})
+            {
+                if (*cached == buffer)
+                    *cached = 0;
+            }
+            for (IndexedBuffer& binding : uniform_bindings)
+            {
+                if (binding.buffer == buffer)
+                    binding = IndexedBuffer();
+            }
+        }
+
+        void forgetTexture(GLuint texture)
+        {
+            for (GLuint& cached : textures)
+            {
+                if (cached == texture)
+                    cached = 0;
+            }
+        }
+
+        // Calls issued and elided since the last endFrame()
+        const Stats& getStats() const { return stats; }
+        // Same for the last complete frame
+        const Stats& getFrameStats() const { return last_frame; }
+
+        void endFrame()
+        {
+            last_frame = stats;
+            stats = Stats();
+        }
+
+    private:
+        static constexpr GLuint UNKNOWN = ~0u;
+
+        struct Rect
+        {
+            GLint x = -1;
+            GLint y = -1;
+            GLsizei width = -1;
+            GLsizei height = -1;
+
+            bool operator==(const Rect& other) const
+            {
+                return x == other.x && y == other.y && width == other.width && height == other.height;
+            }
+        };
+
+        struct IndexedBuffer
+        {
+            GLuint buffer = UNKNOWN;
+            GLintptr offset = 0;
+            GLsizeiptr size = 0;
+        };
+
+        GLuint current_program = UNKNOWN;
+        GLuint current_vertex_array = UNKNOWN;
+        GLuint array_buffer = UNKNOWN;
+        GLuint element_buffer = UNKNOWN;
+        GLuint uniform_buffer = UNKNOWN;
+        IndexedBuffer uniform_bindings[UNIFORM_BINDINGS];
+        GLuint active_unit = UNKNOWN;
+        GLuint textures[TEXTURE_UNITS] = {UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+                                          UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN};
+        // -1 unknown, 0 disabled, 1 enabled
+        int blend = -1;
+        int scissor_test = -1;
+        int depth_test = -1;
+        int cull_face = -1;
+        int depth_mask = -1;
+        GLenum blend_source = UNKNOWN;
+        GLenum blend_destination = UNKNOWN;
+        GLenum depth_function = UNKNOWN;
+        Rect scissor_rect;
+        Rect viewport_rect;
+
+        Stats stats;
+        Stats last_frame;
+
+        GLState() = default;
+        GLState(const Stats& stats, const Stats& last_frame)
+        : stats(stats), last_frame(last_frame)
+        {
+        }
+
+        // Stores the new value and counts the call, returns false when it
+        // can be skipped
+        template<typename T>
+        bool changed(T& cached, const T& value)
+        {
+            if (cached == value)
+            {
+                stats.elided++;
+                return false;
+            }
+            cached = value;
+            stats.issued++;
+            return true;
+        }
+
+        void activeTexture(GLuint unit)
+        {
+            if (!changed(active_unit, unit))
+                return;
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+
+        GLuint* bufferSlot(GLenum target)
+        {
+            switch (target)
+            {
+                case GL_ARRAY_BUFFER: return &array_buffer;
+                case GL_ELEMENT_ARRAY_BUFFER: return &element_buffer;
+                case GL_UNIFORM_BUFFER: return &uniform_buffer;
+                default: return nullptr;
+            }
+        }
+
+        int* capabilitySlot(GLenum capability)
+        {
+            switch (capability)
+            {
+                case GL_BLEND: return &blend;
+                case GL_SCISSOR_TEST: return &scissor_test;
+                case GL_DEPTH_TEST: return &depth_test;
+                case GL_CULL_FACE: return &cull_face;
+                default: return nullptr;
+            }
+        }
+    };
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gl_state.hpp"
+
+namespace lumina
+{
+    // Single channel texture pages that small images, glyphs, are packed
+    // into as they are requested. Every page is split into shelves: rows as
+    // high as the first image put there, filled left to right. An image
+    // goes onto the lowest fitting shelf that does not waste too much
+    // height, otherwise a new shelf is opened, otherwise a new page.
+    //
+    // Images are written into a CPU copy of the page. flush() uploads the
+    // rectangle that changed since the last flush, one glTexSubImage2D per
+    // page, so glyphs added while laying out a frame go up together.
+    class GlyphAtlas
+    {
+    public:
+        struct Region
+        {
+            uint32_t page = 0;
+            int x = 0;
+            int y = 0;
+            int width = 0;
+            int height = 0;
+        };
+
+        explicit GlyphAtlas(int page_size = 1024, int padding = 1)
+        : page_size(page_size), padding(padding)
+        {
+        }
+
+        ~GlyphAtlas()
+        {
+            for (Page& page : pages)
+            {
+                GLState::shared().forgetTexture(page.texture);
+                glDeleteTextures(1, &page.texture);
+            }
+        }
+
+        GlyphAtlas(const GlyphAtlas&) = delete;
+        GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+        // Reserves width x height pixels, cleared to 0. Returns false when
+        // the image is larger than a page.
+        bool allocate(int width, int height, Region& region)
+        {
+            if (width + padding > page_size || height + padding > page_size)
+                return false;
+            region.width = width;
+            region.height = height;
+            if (width == 0 || height == 0)
+                return true;
+
+            if (pages.empty() || !allocateOn(pages.back(), width + padding, height + padding, region))
+            {
+                addPage();
+                allocateOn(pages.back(), width + padding, height + padding, region);
+            }
+            region.page = static_cast<uint32_t>(pages.size() - 1);
+            return true;
+        }
+
+        // Top left pixel of the region in the CPU copy, rows are getStride() apart
+        uint8_t* getPixels(const Region& region)
+        {
+            return pages[region.page].pixels.data() + static_cast<size_t>(region.y) * page_size + region.x;
+        }
+
+        int getStride() const { return page_size; }
+
+        // Call after writing to the pixels of a region
+        void markDirty(const Region& region)
+        {
+            if (region.width == 0 || region.height == 0)
+                return;
+            Page& page = pages[region.page];
+            page.dirty_x0 = std::min(page.dirty_x0, region.x);
+            page.dirty_y0 = std::min(page.dirty_y0, region.y);
+            page.dirty_x1 = std::max(page.dirty_x1, region.x + region.width);
+            page.dirty_y1 = std::max(page.dirty_y1, region.y + region.height);
+        }
+
+        bool isDirty() const
+        {
+            for (const Page& page : pages)
+            {
+                if (page.dirty_x0 < page.dirty_x1)
+                    return true;
+            }
+            return false;
+        }
+
+        // Uploads the changed rectangle of every page, returns the number of uploads
+        size_t flush()
+        {
+            size_t uploads = 0;
+            for (Page& page : pages)
+            {
+                if (page.dirty_x0 >= page.dirty_x1)
+                    continue;
+                GLState::shared().bindTexture(0, GL_TEXTURE_2D, page.texture);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, page_size);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, page.dirty_x0, page.dirty_y0,
+                                page.dirty_x1 - page.dirty_x0, page.dirty_y1 - page.dirty_y0, GL_RED, GL_UNSIGNED_BYTE,
+                                page.pixels.data() + static_cast<size_t>(page.dirty_y0) * page_size + page.dirty_x0);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                page.dirty_x0 = page.dirty_y0 = page_size;
+                page.dirty_x1 = page.dirty_y1 = 0;
+                uploads++;
+            }
+            return uploads;
+        }
+
+        GLuint getTexture(uint32_t page) const { return pages[page].texture; }
+        size_t getPageCount() const { return pages.size(); }
+        int getPageSize() const { return page_size; }
+
+    private:
+        struct Shelf
+        {
+            int y;
+            int height;
+            int x;
+        };
+
+        struct Page
+        {
+            GLuint texture = 0;
+            std::vector<uint8_t> pixels;
+            std::vector<Shelf> shelves;
+            int next_y = 0;
+            int dirty_x0 = 0;
+            int dirty_y0 = 0;
+            int dirty_x1 = 0;
+            int dirty_y1 = 0;
+        };
+
+        int page_size;
+        int padding;
+        std::vector<Page> pages;
+
+        bool allocateOn(Page& page, int width, int height, Region& region)
+        {
+            Shelf* best = nullptr;
+            for (Shelf& shelf : page.shelves)
+            {
+                // Shelves much higher than the image would waste the rest
+                if (shelf.height < height || shelf.height > height + height / 2 + 2 || shelf.x + width > page_size)
+                    continue;
+                if (!best || shelf.height < best->height)
+                    best = &shelf;
+            }
+
+            if (!best)
+            {
+                if (page.next_y + height > page_size)
+                    return false;
+                page.shelves.push_back({page.next_y, height, 0});
+                page.next_y += height;
+                best = &page.shelves.back();
+            }
+
+            region.x = best->x;
+            region.y = best->y;
+            best->x += width;
+            return true;
+        }
+
+        void addPage()
+        {
+            Page page;
+            page.pixels.assign(static_cast<size_t>(page_size) * page_size, 0);
+            page.dirty_x0 = page.dirty_y0 = page_size;
+
+            glGenTextures(1, &page.texture);
+            GLState::shared().bindTexture(0, GL_TEXTURE_2D, page.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, page_size, page_size, 0, GL_RED, GL_UNSIGNED_BYTE, page.pixels.data());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            pages.push_back(std::move(page));
+        }
+    };
+}
@@ -0,0 +1,521 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <nlohmann/json.hpp>
+
+#include "../mesh.hpp"
+#include "../mapped_file.hpp"
+
+namespace lumina::importers
+{
+    // glTF 2.0 importer (.gltf with external .bin buffers or base64 data URIs).
+    //
+    // Every triangle primitive becomes one Mesh. Accessors that live in a
+    // buffer view are uploaded by handing the whole buffer view to GL and
+    // pointing the vertex attributes at it with the accessor offset and the
+    // view stride, so interleaved or planar glTF layouts reach the GPU without
+    // being repacked. Only sparse accessors and accessors without a buffer view
+    // are decoded on the CPU first.
+    //
+    // Attribute locations: POSITION = 0, COLOR_0 = 1, TEXCOORD_0 = 2, NORMAL = 3.
+    // Node transforms, materials and skins are not imported.
+    class GltfImporter
+    {
+    public:
+        static std::vector<std::shared_ptr<Mesh>> loadFile(const std::string& filename)
+        {
+            std::vector<std::shared_ptr<Mesh>> meshes;
+
+            nlohmann::json root;
+            {
+                std::ifstream file(filename);
+                if (!file.is_open())
+                {
+                    std::cerr << "GltfImporter: Unable to open file: " << filename << std::endl;
+                    return meshes;
+                }
+                try
+                {
+                    file >> root;
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << "GltfImporter: JSON error in " << filename << ": " << e.what() << std::endl;
+                    return meshes;
+                }
+            }
+
+            Document document{root, {}};
+            std::filesystem::path base_path = std::filesystem::path(filename).parent_path();
+            if (!loadBuffers(document, base_path))
+                return meshes;
+
+            try
+            {
+                for (const auto& mesh : root.value("meshes", nlohmann::json::array()))
+                {
+                    for (const auto& primitive : mesh.value("primitives", nlohmann::json::array()))
+                    {
+                        if (primitive.value("mode", 4) != 4)
+                        {
+                            std::cerr << "GltfImporter: Skipping non triangle primitive in " << filename << std::endl;
+                            continue;
+                        }
+                        if (auto result = loadPrimitive(document, primitive))
+                            meshes.push_back(result);
+                    }
+                }
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "GltfImporter: Invalid document " << filename << ": " << e.what() << std::endl;
+            }
+
+            return meshes;
+        }
+
+    private:
+        struct Buffer
+        {
+            MappedFile file;
+            std::vector<unsigned char> decoded;
+            const unsigned char* data = nullptr;
+            size_t size = 0;
+        };
+
+        struct Document
+        {
+            const nlohmann::json& root;
+            std::vector<std::unique_ptr<Buffer>> buffers;
+        };
+
+        // Resolved location of an accessor inside a buffer
+        struct View
+        {
+            const unsigned char* data; // start of the buffer view
+            size_t size;               // length of the buffer view
+            size_t offset;             // accessor offset inside the view
+            size_t stride;             // distance between elements
+            int view_index;
+        };
+
+        static int componentCount(const std::string& type)
+        {
+            if (type == "SCALAR") return 1;
+            if (type == "VEC2") return 2;
+            if (type == "VEC3") return 3;
+            if (type == "VEC4") return 4;
+            return 0;
+        }
+
+        static size_t componentSize(GLenum component_type)
+        {
+            switch (component_type)
+            {
+                case GL_BYTE:
+                case GL_UNSIGNED_BYTE: return 1;
+                case GL_SHORT:
+                case GL_UNSIGNED_SHORT: return 2;
+                case GL_UNSIGNED_INT:
+                case GL_FLOAT: return 4;
+                default: return 0;
+            }
+        }
+
+        static bool decodeBase64(const std::string& input, std::vector<unsigned char>& output)
+        {
+            auto value = [](char c) -> int {
+                if (c >= 'A' && c <= 'Z') return c - 'A';
+                if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+                if (c >= '0' && c <= '9') return c - '0' + 52;
+                if (c == '+') return 62;
+                if (c == '/') return 63;
+                return -1;
+            };
+
+            output.clear();
+            output.reserve(input.size() * 3 / 4);
+            unsigned int accumulator = 0;
+            int bits = 0;
+            for (char c : input)
+            {
+                if (c == '=') break;
+                int v = value(c);
+                if (v < 0) return false;
+                accumulator = (accumulator << 6) | static_cast<unsigned int>(v);
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    output.push_back(static_cast<unsigned char>((accumulator >> bits) & 0xFF));
+                }
+            }
+            return true;
+        }
+
+        static bool loadBuffers(Document& document, const std::filesystem::path& base_path)
+        {
+            for (const auto& buffer_json : document.root.value("buffers", nlohmann::json::array()))
+            {
+                auto buffer = std::make_unique<Buffer>();
+                std::string uri = buffer_json.value("uri", "");
+                size_t byte_length = buffer_json.value("byteLength", size_t(0));
+
+                if (uri.rfind("data:", 0) == 0)
+                {
+                    size_t comma = uri.find(',');
+                    if (comma == std::string::npos || uri.find(";base64") > comma ||
+                        !decodeBase64(uri.substr(comma + 1), buffer->decoded))
+                    {
+                        std::cerr << "GltfImporter: Unsupported data URI in buffer" << std::endl;
+                        return false;
+                    }
+                    buffer->data = buffer->decoded.data();
+                    buffer->size = buffer->decoded.size();
+                }
+                else if (!uri.empty())
+                {
+                    std::string path = (base_path / uri).string();
+                    if (!buffer->file.open(path))
+                    {
+                        std::cerr << "GltfImporter: Unable to open buffer: " << path << std::endl;
+                        return false;
+                    }
+                    buffer->data = buffer->file.data();
+                    buffer->size = buffer->file.size();
+                }
+
+                if (buffer->size < byte_length)
+                {
+                    std::cerr << "GltfImporter: Buffer is shorter than its byteLength" << std::endl;
+                    return false;
+                }
+                document.buffers.push_back(std::move(buffer));
+            }
+            return true;
+        }
+
+        static bool resolveView(const Document& document, const nlohmann::json& accessor, View& view)
+        {
+            const auto& root = document.root;
+            int view_index = accessor.at("bufferView").get<int>();
+            const auto& buffer_view = root.at("bufferViews").at(view_index);
+            int buffer_index = buffer_view.at("buffer").get<int>();
+            if (buffer_index < 0 || buffer_index >= static_cast<int>(document.buffers.size()))
+                return false;
+
+            const Buffer& buffer = *document.buffers[buffer_index];
+            size_t view_offset = buffer_view.value("byteOffset", size_t(0));
+            size_t view_length = buffer_view.at("byteLength").get<size_t>();
+
+            GLenum component_type = accessor.at("componentType").get<GLenum>();
+            size_t element_size = componentSize(component_type) * componentCount(accessor.at("type").get<std::string>());
+            size_t count = accessor.at("count").get<size_t>();
+
+            view.data = buffer.data + view_offset;
+            view.size = view_length;
+            view.offset = accessor.value("byteOffset", size_t(0));
+            view.stride = buffer_view.value("byteStride", element_size);
+            view.view_index = view_index;
+
+            return element_size > 0 && view_offset + view_length <= buffer.size &&
+                   (count == 0 || view.offset + (count - 1) * view.stride + element_size <= view_length);
+        }
+
+        static float readComponent(const unsigned char* p, GLenum component_type, bool normalized)
+        {
+            switch (component_type)
+            {
+                case GL_BYTE: {
+                    int8_t v; std::memcpy(&v, p, 1);
+                    return normalized ? std::max(v / 127.0f, -1.0f) : v;
+                }
+                case GL_UNSIGNED_BYTE: {
+                    uint8_t v = *p;
+                    return normalized ? v / 255.0f : v;
+                }
+                case GL_SHORT: {
+                    int16_t v; std::memcpy(&v, p, 2);
+                    return normalized ? std::max(v / 32767.0f, -1.0f) : v;
+                }
+                case GL_UNSIGNED_SHORT: {
+                    uint16_t v; std::memcpy(&v, p, 2);
+                    return normalized ? v / 65535.0f : v;
+                }
+                case GL_UNSIGNED_INT: {
+                    uint32_t v; std::memcpy(&v, p, 4);
+                    return static_cast<float>(v);
+                }
+                case GL_FLOAT: {
+                    float v; std::memcpy(&v, p, 4);
+                    return v;
+                }
+                default:
+                    return 0.0f;
+            }
+        }
+
+        static uint32_t readIndex(const unsigned char* p, GLenum component_type)
+        {
+            switch (component_type)
+            {
+                case GL_UNSIGNED_BYTE: return *p;
+                case GL_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+                case GL_UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+                default: return 0;
+            }
+        }
+
+        // Decodes an accessor into tightly packed floats, applying sparse substitution
+        static bool readAccessorFloats(const Document& document, const nlohmann::json& accessor, std::vector<float>& out)
+        {
+            GLenum component_type = accessor.at("componentType").get<GLenum>();
+            bool normalized = accessor.value("normalized", false);
+            int components = componentCount(accessor.at("type").get<std::string>());
+            size_t count = accessor.at("count").get<size_t>();
+            size_t component_size = componentSize(component_type);
+
+            out.assign(count * components, 0.0f);
+
+            if (accessor.contains("bufferView"))
+            {
+                View view;
+                if (!resolveView(document, accessor, view))
+                    return false;
+                for (size_t i = 0; i < count; i++)
+                {
+                    const unsigned char* element = view.data + view.offset + i * view.stride;
+                    for (int c = 0; c < components; c++)
+                        out[i * components + c] = readComponent(element + c * component_size, component_type, normalized);
+                }
+            }
+
+            if (accessor.contains("sparse"))
+            {
+                const auto& sparse = accessor.at("sparse");
+                size_t sparse_count = sparse.at("count").get<size_t>();
+
+                nlohmann::json index_accessor = sparse.at("indices");
+                index_accessor["count"] = sparse_count;
+                index_accessor["type"] = "SCALAR";
+                nlohmann::json value_accessor = sparse.at("values");
+                value_accessor["count"] = sparse_count;
+                value_accessor["type"] = accessor.at("type");
+                value_accessor["componentType"] = component_type;
+
+                View index_view, value_view;
+                if (!resolveView(document, index_accessor, index_view) || !resolveView(document, value_accessor, value_view))
+                    return false;
+
+                GLenum index_type = index_accessor.at("componentType").get<GLenum>();
+                for (size_t i = 0; i < sparse_count; i++)
+                {
+                    uint32_t target = readIndex(index_view.data + index_view.offset + i * index_view.stride, index_type);
+                    if (target >= count)
+                        return false;
+                    const unsigned char* element = value_view.data + value_view.offset + i * value_view.stride;
+                    for (int c = 0; c < components; c++)
+                        out[target * components + c] = readComponent(element + c * component_size, component_type, normalized);
+                }
+            }
+            return true;
+        }
+
+        static std::shared_ptr<Mesh> loadPrimitive(const Document& document, const nlohmann::json& primitive)
+        {
+            static const std::pair<const char*, GLuint> semantic_locations[] = {
+                {"POSITION", 0}, {"COLOR_0", 1}, {"TEXCOORD_0", 2}, {"NORMAL", 3}
+            };
+
+            const auto& root = document.root;
+            const auto& attributes = primitive.at("attributes");
+            if (!attributes.contains("POSITION"))
+            {
+                std::cerr << "GltfImporter: Primitive without POSITION" << std::endl;
+                return nullptr;
+            }
+
+            size_t num_vertices = root.at("accessors").at(attributes.at("POSITION").get<int>()).at("count").get<size_t>();
+
+            // Attributes that can be sourced straight from a buffer view, grouped by view
+            std::map<std::pair<int, size_t>, VertexStream> direct_streams;
+            // Attributes that had to be decoded on the CPU, one tightly packed stream each
+            std::vector<std::vector<float>> decoded;
+            std::vector<VertexStream> streams;
+
+            for (const auto& [semantic, location] : semantic_locations)
+            {
+                if (!attributes.contains(semantic))
+                    continue;
+
+                const auto& accessor = root.at("accessors").at(attributes.at(semantic).get<int>());
+                if (accessor.at("count").get<size_t>() != num_vertices)
+                {
+                    std::cerr << "GltfImporter: Attribute " << semantic << " has a mismatching count" << std::endl;
+                    return nullptr;
+                }
+
+                GLenum component_type = accessor.at("componentType").get<GLenum>();
+                GLint components = componentCount(accessor.at("type").get<std::string>());
+                GLboolean normalized = accessor.value("normalized", false) ? GL_TRUE : GL_FALSE;
+
+                View view;
+                if (accessor.contains("bufferView") && !accessor.contains("sparse") && resolveView(document, accessor, view))
+                {
+                    auto key = std::make_pair(view.view_index, view.stride);
+                    auto it = direct_streams.find(key);
+                    if (it == direct_streams.end())
+                    {
+                        it = direct_streams.emplace(key, VertexStream{view.data, view.size, static_cast<GLsizei>(view.stride), {}}).first;
+                    }
+                    it->second.attributes.push_back({location, components, component_type, normalized, static_cast<GLuint>(view.offset)});
+                }
+                else
+                {
+                    decoded.emplace_back();
+                    if (!readAccessorFloats(document, accessor, decoded.back()))
+                    {
+                        std::cerr << "GltfImporter: Invalid accessor for " << semantic << std::endl;
+                        return nullptr;
+                    }
+                    // Normalization already happened while decoding
+                    streams.push_back({decoded.back().data(), decoded.back().size() * sizeof(float),
+                                       static_cast<GLsizei>(components * sizeof(float)),
+                                       {{location, components, GL_FLOAT, GL_FALSE, 0}}});
+                }
+            }
+
+            for (auto& [key, stream] : direct_streams)
+            {
+                streams.push_back(std::move(stream));
+            }
+
+            // Indices: tightly packed 8/16 bit index buffer views are uploaded as
+            // they are, 32 bit ones go through the mesh to be narrowed if possible
+            std::vector<unsigned int> index_storage;
+            const unsigned int* index_data = nullptr;
+            const unsigned char* native_indices = nullptr;
+            GLenum native_type = GL_UNSIGNED_INT;
+            size_t num_indices = 0;
+
+            if (primitive.contains("indices"))
+            {
+                const auto& accessor = root.at("accessors").at(primitive.at("indices").get<int>());
+                GLenum component_type = accessor.at("componentType").get<GLenum>();
+                num_indices = accessor.at("count").get<size_t>();
+
+                View view;
+                bool has_view = accessor.contains("bufferView") && resolveView(document, accessor, view);
+                if (accessor.contains("bufferView") && !has_view)
+                {
+                    std::cerr << "GltfImporter: Invalid index accessor" << std::endl;
+                    return nullptr;
+                }
+
+                size_t index_size = indexTypeSize(component_type);
+                if (has_view && !accessor.contains("sparse") && component_type != GL_UNSIGNED_INT &&
+                    view.stride == index_size && (reinterpret_cast<uintptr_t>(view.data + view.offset) % index_size) == 0)
+                {
+                    native_indices = view.data + view.offset;
+                    native_type = component_type;
+                }
+                else if (has_view && !accessor.contains("sparse"))
+                {
+                    index_storage.resize(num_indices);
+                    for (size_t i = 0; i < num_indices; i++)
+                        index_storage[i] = readIndex(view.data + view.offset + i * view.stride, component_type);
+                    index_data = index_storage.data();
+                }
+                else
+                {
+                    std::cerr << "GltfImporter: Sparse or empty index accessors are not supported" << std::endl;
+                    return nullptr;
+                }
+            }
+            else
+            {
+                index_storage.resize(num_vertices);
+                for (size_t i = 0; i < num_vertices; i++)
+                    index_storage[i] = static_cast<unsigned int>(i);
+                index_data = index_storage.data();
+                num_indices = num_vertices;
+            }
+
+            for (size_t i = 0; i < num_indices; i++)
+            {
+                uint32_t index = native_indices ? readIndex(native_indices + i * indexTypeSize(native_type), native_type) : index_data[i];
+                if (index >= num_vertices)
+                {
+                    std::cerr << "GltfImporter: Index out of range" << std::endl;
+                    return nullptr;
+                }
+            }
+
+            std::shared_ptr<Mesh> mesh;
+            if (native_indices)
+            {
+                mesh = std::make_shared<Mesh>(streams, static_cast<unsigned int>(num_vertices), native_indices,
+                                              static_cast<unsigned int>(num_indices), native_type);
+            }
+            else
+            {
+                mesh = std::make_shared<Mesh>(streams, static_cast<unsigned int>(num_vertices),
+                                              index_data, static_cast<unsigned int>(num_indices));
+            }
+            // COLOR_0 defaults to white in glTF
+            if (!attributes.contains("COLOR_0"))
+                mesh->setConstantAttribute(1, glm::vec4(1.0f));
+            mesh->setBounds(readPositionBounds(document, root.at("accessors").at(attributes.at("POSITION").get<int>())));
+            return mesh;
+        }
+
+        // From the min and max the spec requires on POSITION accessors, decoded
+        // from the data when a file leaves them out
+        static Bounds readPositionBounds(const Document& document, const nlohmann::json& accessor)
+        {
+            if (accessor.contains("min") && accessor.contains("max") &&
+                accessor.at("min").size() == 3 && accessor.at("max").size() == 3)
+            {
+                GLenum component_type = accessor.at("componentType").get<GLenum>();
+                bool normalized = accessor.value("normalized", false);
+                glm::vec3 box_min, box_max;
+                for (int c = 0; c < 3; c++)
+                {
+                    box_min[c] = normalizeComponent(accessor.at("min")[c].get<double>(), component_type, normalized);
+                    box_max[c] = normalizeComponent(accessor.at("max")[c].get<double>(), component_type, normalized);
+                }
+                return Bounds::fromBox(box_min, box_max);
+            }
+
+            std::vector<float> positions;
+            if (!readAccessorFloats(document, accessor, positions))
+                return Bounds();
+            return Bounds::fromPositions(positions.data(), positions.size() / 3);
+        }
+
+        // Accessor min and max are in the stored type, like readComponent
+        static float normalizeComponent(double value, GLenum component_type, bool normalized)
+        {
+            if (!normalized)
+                return static_cast<float>(value);
+            switch (component_type)
+            {
+                case GL_BYTE: return std::max(static_cast<float>(value / 127.0), -1.0f);
+                case GL_UNSIGNED_BYTE: return static_cast<float>(value / 255.0);
+                case GL_SHORT: return std::max(static_cast<float>(value / 32767.0), -1.0f);
+                case GL_UNSIGNED_SHORT: return static_cast<float>(value / 65535.0);
+                default: return static_cast<float>(value);
+            }
+        }
+    };
+}
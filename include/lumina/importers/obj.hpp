@@ -0,0 +1,466 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "../mesh.hpp"
+#include "../mapped_file.hpp"
+#include "../geometry_parser.hpp"
+
+namespace lumina::importers
+{
+    // Wavefront OBJ importer.
+    //
+    // Large files are split at line boundaries and parsed on several threads.
+    // Face corners (v/vt/vn triples) are then deduplicated through a hash table
+    // so every unique combination becomes exactly one vertex. Polygons are
+    // triangulated as fans. The common "v x y z r g b" vertex color extension
+    // is supported; groups, objects and materials are ignored.
+    class ObjImporter
+    {
+    public:
+        static std::shared_ptr<Mesh> loadFile(const std::string& filename, unsigned int num_threads = 0,
+                                              const VertexLayout& layout = VertexLayout())
+        {
+            auto positions = std::make_shared<std::vector<float>>();
+            auto colors = std::make_shared<std::vector<float>>();
+            auto uvs = std::make_shared<std::vector<float>>();
+            auto normals = std::make_shared<std::vector<float>>();
+            auto indices = std::make_shared<std::vector<unsigned int>>();
+
+            if (!parseFile(filename, *positions, *colors, *uvs, *normals, *indices, num_threads))
+                return nullptr;
+
+            if (colors->empty()) colors = nullptr;
+            if (uvs->empty()) uvs = nullptr;
+            if (normals->empty()) normals = nullptr;
+
+            auto mesh = std::make_shared<Mesh>(positions, indices, colors, uvs, normals, layout);
+            // Uncolored meshes render white, like the text format
+            if (!colors)
+                mesh->setConstantAttribute(1, glm::vec4(1.0f));
+            return mesh;
+        }
+
+        // Produces deduplicated vertex streams. Streams that are not present in
+        // the file are left empty.
+        static bool parseFile(const std::string& filename,
+                              std::vector<float>& positions,
+                              std::vector<float>& colors,
+                              std::vector<float>& uvs,
+                              std::vector<float>& normals,
+                              std::vector<unsigned int>& indices,
+                              unsigned int num_threads = 0)
+        {
+            MappedFile file(filename);
+            if (!file.isOpen())
+            {
+                std::cerr << "ObjImporter: Unable to open file: " << filename << std::endl;
+                return false;
+            }
+
+            const char* begin = reinterpret_cast<const char*>(file.data());
+            const char* end = begin + file.size();
+
+            std::vector<Chunk> chunks = splitIntoChunks(begin, end, num_threads);
+            if (chunks.size() == 1)
+            {
+                parseChunk(chunks[0]);
+            }
+            else
+            {
+                std::vector<std::thread> workers;
+                workers.reserve(chunks.size() - 1);
+                for (size_t i = 1; i < chunks.size(); i++)
+                {
+                    workers.emplace_back(parseChunk, std::ref(chunks[i]));
+                }
+                parseChunk(chunks[0]);
+                for (std::thread& worker : workers) worker.join();
+            }
+
+            Attributes attributes;
+            std::vector<Corner> corners;
+            merge(chunks, attributes, corners);
+
+            return buildVertices(filename, attributes, corners, positions, colors, uvs, normals, indices);
+        }
+
+    private:
+        static constexpr int32_t MISSING = std::numeric_limits<int32_t>::min();
+        static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+        // Indices into the position, uv and normal arrays. While a chunk is
+        // parsed, relative (negative) references are stored relative to the
+        // start of the chunk and flagged so they can be rebased when merging.
+        struct Corner
+        {
+            int32_t v = MISSING;
+            int32_t vt = MISSING;
+            int32_t vn = MISSING;
+            uint8_t relative = 0; // bit 0: v, bit 1: vt, bit 2: vn
+        };
+
+        struct Attributes
+        {
+            std::vector<float> positions;
+            std::vector<float> colors;
+            std::vector<float> uvs;
+            std::vector<float> normals;
+            bool has_colors = false;
+        };
+
+        struct Chunk
+        {
+            const char* begin;
+            const char* end;
+            Attributes attributes;
+            std::vector<Corner> corners;
+        };
+
+        static std::vector<Chunk> splitIntoChunks(const char* begin, const char* end, unsigned int num_threads)
+        {
+            size_t bytes = static_cast<size_t>(end - begin);
+            if (num_threads == 0)
+            {
+                num_threads = bytes < 4 * MIN_CHUNK_BYTES ? 1 : std::thread::hardware_concurrency();
+            }
+            size_t pieces = std::max<size_t>(1, std::min<size_t>(num_threads, bytes / MIN_CHUNK_BYTES));
+
+            std::vector<Chunk> chunks;
+            const char* chunk_begin = begin;
+            for (size_t i = 0; i < pieces; i++)
+            {
+                const char* chunk_end = end;
+                if (i + 1 < pieces)
+                {
+                    chunk_end = simd::findChar(begin + bytes * (i + 1) / pieces, end, '\n');
+                    if (chunk_end < end) ++chunk_end;
+                }
+                if (chunk_end <= chunk_begin && !chunks.empty())
+                    continue;
+                chunks.push_back({chunk_begin, chunk_end, {}, {}});
+                chunk_begin = chunk_end;
+            }
+            return chunks;
+        }
+
+        static bool isSpace(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        static const char* skipSpaces(const char* p, const char* end)
+        {
+            while (p < end && isSpace(*p))
+                ++p;
+            return p;
+        }
+
+        static bool parseIndex(const char*& p, const char* end, int32_t count, int32_t& index, bool& relative)
+        {
+            int32_t value = 0;
+            auto result = std::from_chars(p, end, value);
+            if (result.ec != std::errc() || value == 0)
+                return false;
+            p = result.ptr;
+
+            // OBJ indices are 1 based, negative values count back from the last element
+            relative = value < 0;
+            index = relative ? count + value : value - 1;
+            return true;
+        }
+
+        static bool parseCorner(const char*& p, const char* end, const Chunk& chunk, Corner& corner)
+        {
+            auto count = [](const std::vector<float>& values, size_t width) {
+                return static_cast<int32_t>(values.size() / width);
+            };
+
+            bool relative = false;
+            if (!parseIndex(p, end, count(chunk.attributes.positions, 3), corner.v, relative))
+                return false;
+            corner.relative |= relative ? 1 : 0;
+
+            if (p < end && *p == '/')
+            {
+                ++p;
+                if (p < end && *p != '/' && !isSpace(*p) && *p != '\n')
+                {
+                    if (!parseIndex(p, end, count(chunk.attributes.uvs, 2), corner.vt, relative))
+                        return false;
+                    corner.relative |= relative ? 2 : 0;
+                }
+                if (p < end && *p == '/')
+                {
+                    ++p;
+                    if (!parseIndex(p, end, count(chunk.attributes.normals, 3), corner.vn, relative))
+                        return false;
+                    corner.relative |= relative ? 4 : 0;
+                }
+            }
+            return true;
+        }
+
+        static void parseChunk(Chunk& chunk)
+        {
+            Attributes& attributes = chunk.attributes;
+            std::vector<Corner> polygon;
+            const char* p = chunk.begin;
+
+            while (p < chunk.end)
+            {
+                const char* line_end = simd::findChar(p, chunk.end, '\n');
+                const char* next = line_end < chunk.end ? line_end + 1 : chunk.end;
+                p = skipSpaces(p, line_end);
+
+                if (line_end - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+                {
+                    float v[6];
+                    const char* q = p + 2;
+                    size_t count = 0;
+                    while (count < 6 && text::parseNumber(q, line_end, v[count]))
+                        ++count;
+                    if (count >= 3)
+                    {
+                        attributes.positions.insert(attributes.positions.end(), v, v + 3);
+                        bool has_color = count == 6;
+                        attributes.has_colors |= has_color;
+                        attributes.colors.push_back(has_color ? v[3] : 1.0f);
+                        attributes.colors.push_back(has_color ? v[4] : 1.0f);
+                        attributes.colors.push_back(has_color ? v[5] : 1.0f);
+                    }
+                }
+                else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+                {
+                    float v[2] = {0.0f, 0.0f};
+                    const char* q = p + 3;
+                    if (text::parseNumber(q, line_end, v[0]))
+                    {
+                        text::parseNumber(q, line_end, v[1]);
+                        attributes.uvs.insert(attributes.uvs.end(), v, v + 2);
+                    }
+                }
+                else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+                {
+                    float v[3];
+                    const char* q = p + 3;
+                    if (text::parseNumber(q, line_end, v[0]) && text::parseNumber(q, line_end, v[1]) &&
+                        text::parseNumber(q, line_end, v[2]))
+                    {
+                        attributes.normals.insert(attributes.normals.end(), v, v + 3);
+                    }
+                }
+                else if (line_end - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+                {
+                    polygon.clear();
+                    const char* q = skipSpaces(p + 2, line_end);
+                    bool valid = true;
+                    while (q < line_end)
+                    {
+                        Corner corner;
+                        if (!parseCorner(q, line_end, chunk, corner))
+                        {
+                            valid = false;
+                            break;
+                        }
+                        polygon.push_back(corner);
+                        q = skipSpaces(q, line_end);
+                    }
+
+                    if (valid)
+                    {
+                        for (size_t i = 2; i < polygon.size(); i++)
+                        {
+                            chunk.corners.push_back(polygon[0]);
+                            chunk.corners.push_back(polygon[i - 1]);
+                            chunk.corners.push_back(polygon[i]);
+                        }
+                    }
+                    else
+                    {
+                        std::cerr << "ObjImporter: Malformed face: " << std::string(p, line_end) << "\n";
+                    }
+                }
+
+                p = next;
+            }
+        }
+
+        // Concatenates the per chunk attribute arrays and rebases relative indices
+        static void merge(std::vector<Chunk>& chunks, Attributes& attributes, std::vector<Corner>& corners)
+        {
+            if (chunks.size() == 1)
+            {
+                attributes = std::move(chunks[0].attributes);
+                corners = std::move(chunks[0].corners);
+                return;
+            }
+
+            size_t num_positions = 0, num_uvs = 0, num_normals = 0, num_corners = 0;
+            for (const Chunk& chunk : chunks)
+            {
+                num_positions += chunk.attributes.positions.size();
+                num_uvs += chunk.attributes.uvs.size();
+                num_normals += chunk.attributes.normals.size();
+                num_corners += chunk.corners.size();
+                attributes.has_colors |= chunk.attributes.has_colors;
+            }
+
+            attributes.positions.reserve(num_positions);
+            attributes.colors.reserve(num_positions);
+            attributes.uvs.reserve(num_uvs);
+            attributes.normals.reserve(num_normals);
+            corners.reserve(num_corners);
+
+            for (Chunk& chunk : chunks)
+            {
+                int32_t v_base = static_cast<int32_t>(attributes.positions.size() / 3);
+                int32_t vt_base = static_cast<int32_t>(attributes.uvs.size() / 2);
+                int32_t vn_base = static_cast<int32_t>(attributes.normals.size() / 3);
+
+                for (Corner corner : chunk.corners)
+                {
+                    if (corner.relative & 1) corner.v += v_base;
+                    if (corner.relative & 2) corner.vt += vt_base;
+                    if (corner.relative & 4) corner.vn += vn_base;
+                    corner.relative = 0;
+                    corners.push_back(corner);
+                }
+
+                auto append = [](std::vector<float>& dst, std::vector<float>& src) {
+                    dst.insert(dst.end(), src.begin(), src.end());
+                    std::vector<float>().swap(src);
+                };
+                append(attributes.positions, chunk.attributes.positions);
+                append(attributes.colors, chunk.attributes.colors);
+                append(attributes.uvs, chunk.attributes.uvs);
+                append(attributes.normals, chunk.attributes.normals);
+                std::vector<Corner>().swap(chunk.corners);
+            }
+        }
+
+        static uint64_t hashCorner(const Corner& corner)
+        {
+            uint64_t h = static_cast<uint32_t>(corner.v);
+            h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(corner.vt);
+            h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(corner.vn);
+            h ^= h >> 29;
+            h *= 0xBF58476D1CE4E5B9ull;
+            h ^= h >> 32;
+            return h;
+        }
+
+        static bool buildVertices(const std::string& filename,
+                                  const Attributes& attributes,
+                                  const std::vector<Corner>& corners,
+                                  std::vector<float>& positions,
+                                  std::vector<float>& colors,
+                                  std::vector<float>& uvs,
+                                  std::vector<float>& normals,
+                                  std::vector<unsigned int>& indices)
+        {
+            const int32_t num_positions = static_cast<int32_t>(attributes.positions.size() / 3);
+            const int32_t num_uvs = static_cast<int32_t>(attributes.uvs.size() / 2);
+            const int32_t num_normals = static_cast<int32_t>(attributes.normals.size() / 3);
+
+            bool use_uvs = false, use_normals = false;
+            for (const Corner& corner : corners)
+            {
+                use_uvs |= corner.vt != MISSING;
+                use_normals |= corner.vn != MISSING;
+            }
+
+            // Open addressed table mapping a corner to its output vertex
+            size_t capacity = 16;
+            while (capacity < corners.size() * 2) capacity <<= 1;
+            std::vector<Corner> keys(capacity);
+            std::vector<unsigned int> values(capacity);
+            std::vector<uint8_t> used(capacity, 0);
+            const size_t mask = capacity - 1;
+
+            positions.clear();
+            colors.clear();
+            uvs.clear();
+            normals.clear();
+            indices.clear();
+            indices.reserve(corners.size());
+
+            size_t skipped = 0;
+            for (size_t t = 0; t + 2 < corners.size(); t += 3)
+            {
+                bool valid = true;
+                for (size_t k = 0; k < 3; k++)
+                {
+                    const Corner& c = corners[t + k];
+                    valid &= c.v >= 0 && c.v < num_positions;
+                    valid &= c.vt == MISSING || (c.vt >= 0 && c.vt < num_uvs);
+                    valid &= c.vn == MISSING || (c.vn >= 0 && c.vn < num_normals);
+                }
+                if (!valid)
+                {
+                    ++skipped;
+                    continue;
+                }
+
+                for (size_t k = 0; k < 3; k++)
+                {
+                    const Corner& c = corners[t + k];
+                    size_t slot = hashCorner(c) & mask;
+                    while (used[slot] && !(keys[slot].v == c.v && keys[slot].vt == c.vt && keys[slot].vn == c.vn))
+                    {
+                        slot = (slot + 1) & mask;
+                    }
+
+                    if (!used[slot])
+                    {
+                        used[slot] = 1;
+                        keys[slot] = c;
+                        values[slot] = static_cast<unsigned int>(positions.size() / 3);
+
+                        positions.insert(positions.end(), &attributes.positions[c.v * 3], &attributes.positions[c.v * 3] + 3);
+                        if (attributes.has_colors)
+                        {
+                            colors.insert(colors.end(), &attributes.colors[c.v * 3], &attributes.colors[c.v * 3] + 3);
+                        }
+                        if (use_uvs)
+                        {
+                            const float* uv = c.vt != MISSING ? &attributes.uvs[c.vt * 2] : nullptr;
+                            uvs.push_back(uv ? uv[0] : 0.0f);
+                            uvs.push_back(uv ? uv[1] : 0.0f);
+                        }
+                        if (use_normals)
+                        {
+                            const float* n = c.vn != MISSING ? &attributes.normals[c.vn * 3] : nullptr;
+                            normals.push_back(n ? n[0] : 0.0f);
+                            normals.push_back(n ? n[1] : 0.0f);
+                            normals.push_back(n ? n[2] : 0.0f);
+                        }
+                    }
+
+                    indices.push_back(values[slot]);
+                }
+            }
+
+            if (skipped > 0)
+            {
+                std::cerr << "ObjImporter: Skipped " << skipped << " faces with invalid indices in " << filename << std::endl;
+            }
+            if (positions.empty())
+            {
+                std::cerr << "ObjImporter: No faces found in: " << filename << std::endl;
+                return false;
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+#include "ring_buffer.hpp"
+
+namespace lumina
+{
+    // Collects the model matrices of instanced draws for one frame into a
+    // streaming ring buffer and issues glDrawElementsInstanced with the
+    // matrices fed to the i_model attribute (locations 4 to 7, one column
+    // each), see shaders/instanced_vertex_shader.glsl.
+    class InstanceBatcher
+    {
+    public:
+        static constexpr GLuint MODEL_LOCATION = 4;
+
+        void clear() { transforms.clear(); }
+
+        // Returns the instance index of the transform
+        uint32_t add(const glm::mat4& model)
+        {
+            transforms.push_back(model);
+            return static_cast<uint32_t>(transforms.size() - 1);
+        }
+
+        size_t size() const { return transforms.size(); }
+
+        // Copies everything added since clear() into the ring buffer
+        void upload()
+        {
+            // Created on first use, when a context is current
+            if (!ring)
+                ring = std::make_unique<RingBuffer>(GL_ARRAY_BUFFER, INITIAL_SEGMENT_SIZE);
+
+            size_t bytes = transforms.size() * sizeof(glm::mat4);
+            RingBuffer::Allocation allocation = ring->allocate(bytes, sizeof(glm::mat4));
+            std::memcpy(allocation.data, transforms.data(), bytes);
+            ring->flush();
+            base_offset = allocation.offset;
+        }
+
+        // Call once the draws of this frame are issued
+        void fence()
+        {
+            if (ring)
+                ring->fence();
+        }
+
+        // Draws the instances [first, first + count) of an LOD of the bound mesh
+        void draw(const Mesh& mesh, size_t lod, uint32_t first, uint32_t count) const
+        {
+            // Instance attributes are VAO state, so they are pointed at the
+            // range of this draw on the mesh's VAO
+            GLState::shared().bindBuffer(GL_ARRAY_BUFFER, ring->getBuffer());
+            for (GLuint column = 0; column < 4; column++)
+            {
+                size_t offset = base_offset + static_cast<size_t>(first) * sizeof(glm::mat4) + column * sizeof(glm::vec4);
+                glVertexAttribPointer(MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)offset);
+                glEnableVertexAttribArray(MODEL_LOCATION + column);
+                glVertexAttribDivisor(MODEL_LOCATION + column, 1);
+            }
+            GLState::shared().bindBuffer(GL_ARRAY_BUFFER, 0);
+
+            mesh.drawElementsInstanced(lod, static_cast<GLsizei>(count));
+        }
+
+    private:
+        static constexpr size_t INITIAL_SEGMENT_SIZE = 1 << 20;
+
+        std::unique_ptr<RingBuffer> ring;
+        size_t base_offset = 0;
+        std::vector<glm::mat4> transforms;
+    };
+}
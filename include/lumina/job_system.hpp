@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lumina
+{
+    // Small job system with one queue per thread and work stealing.
+    //
+    // Jobs form a tree: a job created with a parent keeps the parent
+    // unfinished until it completes itself, so waiting on a parent waits on
+    // everything spawned below it, including jobs created while it runs.
+    // Every worker pops its own queue from the back (most recent work, still
+    // warm in cache) and steals from the front of the others when empty.
+    // Threads that are not workers (the main thread, game threads) share
+    // queue 0 and execute jobs while they wait.
+    //
+    // Job storage is a ring of MAX_JOBS slots. A slot is only reused once
+    // its job finished; with all of them in use, createJob() runs jobs until
+    // one frees up. A Job* is only meaningful until the job finished, so
+    // waiting goes through the Handle that run() and submit() return, which
+    // also knows the generation of the slot.
+    class JobSystem
+    {
+    public:
+        struct alignas(64) Job
+        {
+            std::function<void(Job*)> function;
+            Job* parent = nullptr;
+            std::atomic<int32_t> unfinished{0};
+            // Counts the times the slot was claimed
+            std::atomic<uint32_t> generation{0};
+        };
+
+        // A started job, stays valid after its slot was reused
+        struct Handle
+        {
+            const Job* job = nullptr;
+            uint32_t generation = 0;
+        };
+
+        static constexpr size_t MAX_JOBS = 1 << 16;
+
+        // num_workers == 0 starts one worker per hardware thread besides the caller
+        explicit JobSystem(unsigned int num_workers = 0)
+        : jobs(new Job[MAX_JOBS])
+        {
+            if (num_workers == 0)
+            {
+                unsigned int hardware = std::thread::hardware_concurrency();
+                num_workers = hardware > 1 ? hardware - 1 : 0;
+            }
+
+            queues.reserve(num_workers + 1);
+            for (unsigned int i = 0; i < num_workers + 1; i++)
+            {
+                queues.push_back(std::make_unique<Queue>());
+            }
+
+            threads.reserve(num_workers);
+            for (unsigned int i = 0; i < num_workers; i++)
+            {
+                threads.emplace_back(&JobSystem::workerLoop, this, i + 1);
+            }
+        }
+
+        ~JobSystem()
+        {
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        // Process wide pool shared by the engine and game code
+        static JobSystem& shared()
+        {
+            static JobSystem system;
+            return system;
+        }
+
+        // Creates a job without starting it. A null function gives an empty
+        // job that is only useful as the parent of a group.
+        Job* createJob(std::function<void(Job*)> function, Job* parent = nullptr)
+        {
+            Job* job = claimSlot();
+            job->function = std::move(function);
+            job->parent = parent;
+            if (parent)
+            {
+                parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Handle run(Job* job)
+        {
+            // Read before the job can finish and its slot be taken again
+            Handle handle{job, job->generation.load(std::memory_order_relaxed)};
+            Queue& queue = *queues[currentQueue()];
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.jobs.push_back(job);
+            }
+            pending.fetch_add(1, std::memory_order_release);
+            if (!threads.empty())
+            {
+                // Taking the lock orders this with a worker going to sleep
+                { std::lock_guard<std::mutex> lock(wake_mutex); }
+                wake.notify_one();
+            }
+            return handle;
+        }
+
+        Handle submit(std::function<void(Job*)> function, Job* parent = nullptr)
+        {
+            return run(createJob(std::move(function), parent));
+        }
+
+        // A slot claimed by another job since means this one finished
+        bool isFinished(const Handle& handle) const
+        {
+            return handle.job->unfinished.load(std::memory_order_acquire) <= 0 ||
+                   handle.job->generation.load(std::memory_order_acquire) != handle.generation;
+        }
+
+        // Runs other jobs until the given one (and all of its children) finished
+        void wait(const Handle& handle)
+        {
+            size_t index = currentQueue();
+            while (!isFinished(handle))
+            {
+                if (Job* next = takeJob(index))
+                    execute(next);
+                else
+                    std::this_thread::yield();
+            }
+        }
+
+        // Calls function(begin, end) over [0, count) in batches and waits
+        template<typename Function>
+        void parallelFor(size_t count, size_t batch, Function&& function)
+        {
+            if (count == 0)
+                return;
+            // Every batch is a job, so huge counts get bigger batches
+            batch = std::max<size_t>({batch, 1, (count + MAX_BATCHES - 1) / MAX_BATCHES});
+
+            Job* group = createJob(nullptr);
+            for (size_t begin = 0; begin < count; begin += batch)
+            {
+                size_t end = std::min(count, begin + batch);
+                submit([&function, begin, end](Job*) { function(begin, end); }, group);
+            }
+            wait(run(group));
+        }
+
+        unsigned int getWorkerCount() const { return static_cast<unsigned int>(threads.size()); }
+
+        // Most jobs one parallelFor creates
+        static constexpr size_t MAX_BATCHES = 1024;
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Job*> jobs;
+        };
+
+        std::unique_ptr<Job[]> jobs;
+        std::atomic<size_t> next_job{0};
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+
+        std::atomic<int64_t> pending{0};
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        struct ThreadState
+        {
+            const JobSystem* system = nullptr;
+            size_t queue = 0;
+        };
+
+        static ThreadState& threadState()
+        {
+            thread_local ThreadState state;
+            return state;
+        }
+
+        // Takes the next slot whose job finished. Slots still in use are
+        // skipped; when all are, the caller runs jobs until one frees up.
+        Job* claimSlot()
+        {
+            size_t busy = 0;
+            while (true)
+            {
+                Job* job = &jobs[next_job.fetch_add(1, std::memory_order_relaxed) & (MAX_JOBS - 1)];
+                int32_t finished = 0;
+                if (job->unfinished.compare_exchange_strong(finished, 1, std::memory_order_acquire))
+                {
+                    job->generation.fetch_add(1, std::memory_order_release);
+                    return job;
+                }
+
+                if (++busy < MAX_JOBS)
+                    continue;
+                busy = 0;
+                if (Job* next = takeJob(currentQueue()))
+                    execute(next);
+                else
+                    std::this_thread::yield();
+            }
+        }
+
+        size_t currentQueue() const
+        {
+            const ThreadState& state = threadState();
+            return state.system == this ? state.queue : 0;
+        }
+
+        Job* takeJob(size_t index)
+        {
+            // Own queue: newest first
+            {
+                Queue& queue = *queues[index];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.jobs.empty())
+                {
+                    Job* job = queue.jobs.back();
+                    queue.jobs.pop_back();
+                    pending.fetch_sub(1, std::memory_order_relaxed);
+                    return job;
+                }
+            }
+
+            // Steal the oldest job of another queue
+            for (size_t offset = 1; offset < queues.size(); offset++)
+            {
+                Queue& queue = *queues[(index + offset) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.jobs.empty())
+                {
+                    Job* job = queue.jobs.front();
+                    queue.jobs.pop_front();
+                    pending.fetch_sub(1, std::memory_order_relaxed);
+                    return job;
+                }
+            }
+            return nullptr;
+        }
+
+        void execute(Job* job)
+        {
+            if (job->function)
+            {
+                job->function(job);
+                // Releases the captures now instead of when the slot is reused
+                job->function = nullptr;
+            }
+            finish(job);
+        }
+
+        void finish(Job* job)
+        {
+            while (job)
+            {
+                // Once unfinished reaches 0 the slot can be claimed and its
+                // parent overwritten
+                Job* parent = job->parent;
+                if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    return;
+                job = parent;
+            }
+        }
+
+        void workerLoop(size_t index)
+        {
+            threadState() = {this, index};
+
+            while (true)
+            {
+                if (Job* job = takeJob(index))
+                {
+                    execute(job);
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake.wait(lock, [this] { return stopping || pending.load(std::memory_order_acquire) > 0; });
+                if (stopping)
+                    return;
+            }
+        }
+    };
+}
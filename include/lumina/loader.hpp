@@ -32,7 +32,14 @@ namespace lumina
             return root;
         }
 
-        static std::unordered_map<std::string, std::shared_ptr<lumina::Shader>> loadShaders(const std::string& file_path)
+        // All programs are submitted before any is waited for, so the driver
+        // can compile them in parallel. With ShaderBuild::Async the shaders
+        // are returned while still compiling, see Shader::isReady().
+        // With hot_reload the shaders are rebuilt when a source file changes,
+        // see FileWatcher.
+        static std::unordered_map<std::string, std::shared_ptr<lumina::Shader>> loadShaders(const std::string& file_path,
+                                                                                           ShaderBuild build = ShaderBuild::Blocking,
+                                                                                           bool hot_reload = false)
         {
             nlohmann::json root = loadJson(file_path);
 
@@ -63,12 +70,33 @@ namespace lumina
                     }
                     shader_paths[shader_type] = shader_path;
                 }
-                shaders[name] = std::make_shared<lumina::Shader>(shader_paths);
+                auto shader = std::make_shared<lumina::Shader>(shader_paths, ShaderBuild::Async);
+                if (hot_reload)
+                {
+                    for (const auto& [shader_type, shader_path] : shader_paths)
+                    {
+                        FileWatcher::shared().watch(shader_path, shader, [](lumina::Shader& changed, const std::string&) {
+                            changed.reload();
+                        });
+                    }
+                }
+                shaders[name] = shader;
+            }
+
+            if (build == ShaderBuild::Blocking)
+            {
+                for (auto& [name, shader] : shaders)
+                {
+                    shader->wait();
+                }
             }
             return shaders;
         }
 
-        static std::unordered_map<std::string, std::shared_ptr<lumina::Mesh>> loadMeshes(const std::string& file_path)
+        // With hot_reload a mesh takes over the data of its file when it
+        // changes, the Mesh object stays the same
+        static std::unordered_map<std::string, std::shared_ptr<lumina::Mesh>> loadMeshes(const std::string& file_path,
+                                                                                         bool hot_reload = false)
         {
             nlohmann::json root = loadJson(file_path);
             if (!root.contains("meshes"))
@@ -86,7 +114,15 @@ namespace lumina
                     std::cerr << "Error: Mesh path for '" << mesh_path << "' in '" << name << "' is not a valid string." << std::endl;
                     continue;
                 }
-                meshes[name] = GeometryLoader::loadGeometryFromFile(mesh_path);
+                std::string path = mesh_path;
+                meshes[name] = GeometryLoader::loadGeometryFromFile(path);
+                if (hot_reload && meshes[name])
+                {
+                    FileWatcher::shared().watch(path, meshes[name], [](lumina::Mesh& mesh, const std::string& changed) {
+                        if (std::shared_ptr<lumina::Mesh> fresh = GeometryLoader::loadGeometryFromFile(changed))
+                            mesh = std::move(*fresh);
+                    });
+                }
             }
 
             return meshes;
@@ -123,7 +159,7 @@ namespace lumina
         }
 
         static std::unordered_map<std::string, std::shared_ptr<lumina::Texture>>
-        loadTextures(const std::string& directory)
+        loadTextures(const std::string& directory, bool hot_reload = false)
         {
             namespace fs = std::filesystem;
             std::unordered_map<std::string, std::shared_ptr<lumina::Texture>> textures;
@@ -159,6 +195,12 @@ namespace lumina
                 }
 
                 textures[name] = texture;
+                if (hot_reload)
+                {
+                    FileWatcher::shared().watch(path.string(), texture, [](lumina::Texture& changed, const std::string&) {
+                        changed.reload();
+                    });
+                }
 
                 std::cout << "Loaded texture: " << name << " (" << path << ")\n";
             }
@@ -10,13 +10,24 @@
 
 #include "../libs/json.hpp"
 
+#include "file_watcher.hpp"
+#include "gl_state.hpp"
 #include "viewport.hpp"
+#include "program_cache.hpp"
 #include "shader.hpp"
+#include "shader_variants.hpp"
 #include "material.hpp"
 #include "defines.hpp"
 #include "utils.hpp"
 #include "camera.hpp"
+#include "frame_uniforms.hpp"
+#include "job_system.hpp"
+#include "ring_buffer.hpp"
+#include "instancing.hpp"
+#include "render_queue.hpp"
 #include "node.hpp"
+#include "scene.hpp"
+#include "scene_bvh.hpp"
 #include "mesh.hpp"
 #include "font.hpp"
 #include "terminal.hpp"
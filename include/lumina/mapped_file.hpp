@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <string>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lumina
+{
+    // Read-only memory mapping of a whole file. The mapping stays valid
+    // until close() is called or the object is destroyed.
+    class MappedFile
+    {
+        public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::string& path)
+        {
+            open(path);
+        }
+
+        ~MappedFile()
+        {
+            close();
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept
+        {
+            swap(other);
+        }
+
+        MappedFile& operator=(MappedFile&& other) noexcept
+        {
+            if (this != &other)
+            {
+                close();
+                swap(other);
+            }
+            return *this;
+        }
+
+        bool open(const std::string& path)
+        {
+            close();
+#ifdef _WIN32
+            file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file_handle == INVALID_HANDLE_VALUE)
+            {
+                std::cerr << "Unable to open file: " << path << std::endl;
+                return false;
+            }
+
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+            {
+                close();
+                return false;
+            }
+            size_bytes = static_cast<size_t>(file_size.QuadPart);
+
+            mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping_handle)
+            {
+                std::cerr << "Unable to map file: " << path << std::endl;
+                close();
+                return false;
+            }
+
+            mapped = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+            if (!mapped)
+            {
+                std::cerr << "Unable to map file: " << path << std::endl;
+                close();
+                return false;
+            }
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                std::cerr << "Unable to open file: " << path << std::endl;
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0)
+            {
+                ::close(fd);
+                return false;
+            }
+            size_bytes = static_cast<size_t>(st.st_size);
+
+            void* ptr = mmap(nullptr, size_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            // The mapping keeps its own reference to the file
+            ::close(fd);
+
+            if (ptr == MAP_FAILED)
+            {
+                std::cerr << "Unable to map file: " << path << std::endl;
+                size_bytes = 0;
+                return false;
+            }
+            mapped = ptr;
+
+            // Meshes are consumed front to back in a single pass
+            madvise(mapped, size_bytes, MADV_SEQUENTIAL);
+#endif
+            return true;
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (mapped) UnmapViewOfFile(mapped);
+            if (mapping_handle) CloseHandle(mapping_handle);
+            if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+            mapping_handle = nullptr;
+            file_handle = INVALID_HANDLE_VALUE;
+#else
+            if (mapped) munmap(mapped, size_bytes);
+#endif
+            mapped = nullptr;
+            size_bytes = 0;
+        }
+
+        bool isOpen() const { return mapped != nullptr; }
+        const unsigned char* data() const { return static_cast<const unsigned char*>(mapped); }
+        size_t size() const { return size_bytes; }
+
+        private:
+        void swap(MappedFile& other) noexcept
+        {
+            std::swap(mapped, other.mapped);
+            std::swap(size_bytes, other.size_bytes);
+#ifdef _WIN32
+            std::swap(file_handle, other.file_handle);
+            std::swap(mapping_handle, other.mapping_handle);
+#endif
+        }
+
+        void* mapped = nullptr;
+        size_t size_bytes = 0;
+#ifdef _WIN32
+        HANDLE file_handle = INVALID_HANDLE_VALUE;
+        HANDLE mapping_handle = nullptr;
+#endif
+    };
+}
@@ -1,47 +1,264 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
 #include <memory>
 #include <variant>
-#include <unordered_map>
+#include <vector>
 #include <string>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include "shader.hpp"
 
 namespace lumina
 {
-    
-    using UniformValue = std::variant<int, float, glm::vec2, glm::vec3, glm::vec4, glm::mat4>; 
 
+    using UniformValue = std::variant<int, float, glm::vec2, glm::vec3, glm::vec4, glm::mat4>;
+
+    // Uniform values for a shader. Uniforms the shader declares in its
+    // Material block, e.g.
+    //
+    //   layout (std140) uniform Material
+    //   {
+    //       vec4 color;
+    //       float roughness;
+    //   };
+    //
+    // are packed at the offsets the program reports into a uniform buffer
+    // owned by the material, uploaded when a value changed and bound at
+    // Shader::MATERIAL_BINDING. Any other uniform is set with glUniform at
+    // a location resolved once.
+    //
+    // When the shader is reloaded the values are carried over to the new
+    // layout by name. Handles found before the reload have to be found again.
     class Material
     {
         public:
+            // Resolved name of a uniform, see findUniform()
+            struct Handle
+            {
+                int32_t block_offset = -1;
+                GLenum block_type = 0;
+                int32_t loose_index = -1;
+
+                bool isValid() const { return block_offset >= 0 || loose_index >= 0; }
+            };
+
             Material(std::shared_ptr<Shader> shader)
-            : shader(shader)
+            : shader(shader), id(next_id++)
             {
+                if (!shader)
+                    return;
+                revision = shader->getRevision();
+                block_members = shader->getMaterialMembers();
+                if (shader->getMaterialBlockSize() > 0)
+                    block_data.resize(shader->getMaterialBlockSize(), 0);
+            }
 
+            ~Material()
+            {
+                if (block_buffer)
+                {
+                    GLState::shared().forgetBuffer(block_buffer);
+                    glDeleteBuffers(1, &block_buffer);
+                }
             }
+
+            Material(const Material&) = delete;
+            Material& operator=(const Material&) = delete;
+
+            // Looks the name up in the shader. Keep the handle to set the
+            // uniform again without any string lookups.
+            Handle findUniform(const std::string& name)
+            {
+                Handle handle;
+                if (!shader)
+                    return handle;
+                if (shader->getRevision() != revision)
+                    relink();
+
+                if (const Shader::BlockMember* member = shader->findMaterialMember(name))
+                {
+                    handle.block_offset = member->offset;
+                    handle.block_type = member->type;
+                    return handle;
+                }
+
+                for (size_t i = 0; i < loose_uniforms.size(); i++)
+                {
+                    if (loose_uniforms[i].name == name)
+                    {
+                        handle.loose_index = static_cast<int32_t>(i);
+                        return handle;
+                    }
+                }
+                GLint location = shader->getUniformLocation(name);
+                if (location < 0)
+                    return handle;
+                handle.loose_index = static_cast<int32_t>(loose_uniforms.size());
+                loose_uniforms.push_back({name, location, UniformValue(), false});
+                return handle;
+            }
+
             void setUniform(const std::string& name, const UniformValue& value)
             {
-                uniforms[name] = value;
+                // Unknown names include uniforms the compiler removed
+                setUniform(findUniform(name), value);
+            }
+
+            void setUniform(const Handle& handle, const UniformValue& value)
+            {
+                if (handle.loose_index >= 0)
+                {
+                    loose_uniforms[handle.loose_index].value = value;
+                    loose_uniforms[handle.loose_index].is_set = true;
+                    return;
+                }
+                if (handle.block_offset < 0)
+                    return;
+
+                // std140 stores all of these types tightly packed, matrices
+                // as four vec4 columns like glm
+                std::visit([&](auto&& v) {
+                    if (!matchesType(v, handle.block_type))
+                    {
+                        std::cerr << "Material: value does not match the type of the block member" << std::endl;
+                        return;
+                    }
+                    size_t size = sizeof(v);
+                    if (handle.block_offset + size > block_data.size())
+                        return;
+                    uint8_t* target = block_data.data() + handle.block_offset;
+                    if (std::memcmp(target, &v, size) != 0)
+                    {
+                        std::memcpy(target, &v, size);
+                        dirty = true;
+                    }
+                }, value);
             }
+
             void bind(const glm::mat4& model) const
             {
                 if (!shader) return;
                 shader->bind();
-                shader->setUniform("model", model);
+                shader->setUniform(BuiltinUniform::Model, model);
+                apply(*shader);
+            }
 
-                for (const auto& [name, val] : uniforms)
+            // Sets the uniforms on an already bound shader. With only a
+            // Material block this is a single buffer bind.
+            void apply(Shader& target) const
+            {
+                if (shader && shader->getRevision() != revision)
+                    relink();
+
+                if (!block_data.empty())
+                {
+                    if (!block_buffer)
+                    {
+                        glGenBuffers(1, &block_buffer);
+                        GLState::shared().bindBuffer(GL_UNIFORM_BUFFER, block_buffer);
+                        glBufferData(GL_UNIFORM_BUFFER, block_data.size(), block_data.data(), GL_DYNAMIC_DRAW);
+                        dirty = false;
+                    }
+                    else if (dirty)
+                    {
+                        GLState::shared().bindBuffer(GL_UNIFORM_BUFFER, block_buffer);
+                        glBufferSubData(GL_UNIFORM_BUFFER, 0, block_data.size(), block_data.data());
+                        dirty = false;
+                    }
+                    GLState::shared().bindBufferBase(GL_UNIFORM_BUFFER, Shader::MATERIAL_BINDING, block_buffer);
+                }
+
+                const bool own_shader = &target == shader.get();
+                for (const LooseUniform& uniform : loose_uniforms)
                 {
+                    if (!uniform.is_set)
+                        continue;
+                    GLint location = own_shader ? uniform.location : target.getUniformLocation(uniform.name);
                     std::visit([&](auto&& v) {
-                        shader->setUniform(name, v);
-                    }, val);
+                        Shader::setUniformAt(location, v);
+                    }, uniform.value);
                 }
             }
-            
+
+            const std::shared_ptr<Shader>& getShader() const { return shader; }
+
+            // Unique for the lifetime of the process, starting at 1
+            uint32_t getId() const { return id; }
+
         private:
+            struct LooseUniform
+            {
+                std::string name;
+                GLint location;
+                UniformValue value;
+                bool is_set;
+            };
+
+            static inline std::atomic<uint32_t> next_id{1};
+
             std::shared_ptr<Shader> shader;
-            std::unordered_map<std::string, UniformValue> uniforms;
-    };
-}
+            uint32_t id;
+            // Mutable to follow a reloaded shader while drawing
+            mutable uint32_t revision = 0;
+            mutable std::unordered_map<std::string, Shader::BlockMember> block_members;
+            mutable std::vector<uint8_t> block_data;
+            mutable std::vector<LooseUniform> loose_uniforms;
+            mutable GLuint block_buffer = 0;
+            mutable bool dirty = false;
 
+            // Moves the values to the layout of the reloaded shader
+            void relink() const
+            {
+                revision = shader->getRevision();
 
+                std::vector<uint8_t> old_data(shader->getMaterialBlockSize(), 0);
+                old_data.swap(block_data);
+                for (const auto& [name, member] : shader->getMaterialMembers())
+                {
+                    auto old = block_members.find(name);
+                    size_t size = memberSize(member.type);
+                    if (old == block_members.end() || old->second.type != member.type || size == 0 ||
+                        old->second.offset + size > old_data.size() || member.offset + size > block_data.size())
+                        continue;
+                    std::memcpy(block_data.data() + member.offset, old_data.data() + old->second.offset, size);
+                }
+                block_members = shader->getMaterialMembers();
+
+                // The buffer is created again with the new size
+                if (block_buffer && block_data.size() != old_data.size())
+                {
+                    GLState::shared().forgetBuffer(block_buffer);
+                    glDeleteBuffers(1, &block_buffer);
+                    block_buffer = 0;
+                }
+                dirty = true;
+
+                for (LooseUniform& uniform : loose_uniforms)
+                    uniform.location = shader->getUniformLocation(uniform.name);
+            }
+
+            static size_t memberSize(GLenum type)
+            {
+                switch (type)
+                {
+                    case GL_INT: case GL_BOOL: case GL_FLOAT: return 4;
+                    case GL_FLOAT_VEC2: return 8;
+                    case GL_FLOAT_VEC3: return 12;
+                    case GL_FLOAT_VEC4: return 16;
+                    case GL_FLOAT_MAT4: return 64;
+                    default: return 0;
+                }
+            }
+
+            static bool matchesType(int, GLenum type) { return type == GL_INT || type == GL_BOOL; }
+            static bool matchesType(float, GLenum type) { return type == GL_FLOAT; }
+            static bool matchesType(const glm::vec2&, GLenum type) { return type == GL_FLOAT_VEC2; }
+            static bool matchesType(const glm::vec3&, GLenum type) { return type == GL_FLOAT_VEC3; }
+            static bool matchesType(const glm::vec4&, GLenum type) { return type == GL_FLOAT_VEC4; }
+            static bool matchesType(const glm::mat4&, GLenum type) { return type == GL_FLOAT_MAT4; }
+    };
+}
@@ -1,144 +1,550 @@
 #pragma once
+#include <algorithm>
 #include <vector>
 #include <memory>
+#include <iostream>
+#include <limits>
+#include <utility>
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.hpp"
+#include "gl_state.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet.hpp"
+#include "vertex_layout.hpp"
 
 namespace lumina
 {
+    // Range of the shared index buffer drawn for one level of detail
+    struct MeshLod
+    {
+        unsigned int index_offset; // in indices
+        unsigned int index_count;
+        float error;               // object space deviation from the full mesh
+    };
+
     class Mesh
     {
     private:
         std::shared_ptr<std::vector<float>> positions;
         std::shared_ptr<std::vector<float>> colors;
         std::shared_ptr<std::vector<float>> uvs;
+        std::shared_ptr<std::vector<float>> normals;
 
         std::shared_ptr<std::vector<unsigned int>> indices;
 
-        std::vector<float> interleaved_vertices;
-        unsigned int vertex_stride = 0;
+        VertexLayout layout;
+        std::vector<VertexAttribute> attributes;
+        std::vector<ConstantAttribute> constants;
+        GLsizei vertex_stride = 0; // in bytes
+        glm::vec3 position_offset = glm::vec3(0.0f);
+        glm::vec3 position_scale = glm::vec3(1.0f);
+
+        unsigned int num_vertices = 0;
+        unsigned int num_indices = 0;
+        GLenum index_type = GL_UNSIGNED_INT;
 
-        unsigned int num_vertices;
-        unsigned int num_indices;
+        // Level 0 is the full mesh, all levels share one index buffer
+        std::vector<MeshLod> lods;
+        MeshLodOptions lod_options;
+        // Clusters of the full detail level, empty unless built
+        std::vector<Meshlet> meshlets;
+        MeshletOptions meshlet_options;
+        Bounds bounds;
+        glm::vec3 bounds_center = glm::vec3(0.0f);
+        float bounds_radius = 0.0f;
+
+        unsigned int EBO = 0, VAO = 0;
+        std::vector<unsigned int> VBOs;
+
+        void setLayout(const PackedVertexLayout& packed)
+        {
+            attributes = packed.attributes;
+            constants = packed.constants;
+            vertex_stride = packed.stride;
+            position_offset = packed.position_offset;
+            position_scale = packed.position_scale;
+        }
 
-        unsigned int EBO = 0, VBO = 0, VAO = 0;
+        void setup()
+        {
+            // The packed copy only lives until it is in the vertex buffer
+            PackedVertices packed = packVertices(*positions, colors.get(), uvs.get(), normals.get(), layout);
+            setLayout(packed.layout);
+            computeBounds();
+            lods = {{0, num_indices, 0.0f}};
+            uploadNarrowed({{packed.data.data(), packed.data.size(), vertex_stride, attributes}},
+                           indices->data(), indices->size());
+        }
 
-        void interleave()
+        void computeBounds()
         {
-            interleaved_vertices.clear();
-            size_t count = positions->size() / 3;
-            vertex_stride = 3 + (colors ? 3 : 0) + (uvs ? 2 : 0);
+            if (positions->empty())
+                return;
+            bounds = Bounds::fromPositions(positions->data(), positions->size() / 3);
+            bounds_center = bounds.center;
+            bounds_radius = bounds.radius;
+        }
 
+        // Picks the smallest index type that fits and returns the data to
+        // upload, which is either index_data itself or storage.
+        const void* narrowIndices(const unsigned int* index_data, size_t count,
+                                  std::vector<unsigned char>& storage, size_t& bytes)
+        {
+            unsigned int max_index = 0;
             for (size_t i = 0; i < count; i++)
             {
-                // Position
-                interleaved_vertices.push_back((*positions)[i * 3 + 0]);
-                interleaved_vertices.push_back((*positions)[i * 3 + 1]);
-                interleaved_vertices.push_back((*positions)[i * 3 + 2]);
+                max_index = std::max(max_index, index_data[i]);
+            }
 
-                // Color (optional)
-                if (colors && colors->size() >= i * 3 + 3)
-                {
-                    interleaved_vertices.push_back((*colors)[i * 3 + 0]);
-                    interleaved_vertices.push_back((*colors)[i * 3 + 1]);
-                    interleaved_vertices.push_back((*colors)[i * 3 + 2]);
-                }
+            index_type = selectIndexType(max_index, layout.byte_indices);
+            bytes = count * indexTypeSize(index_type);
+            if (index_type == GL_UNSIGNED_INT)
+                return index_data;
+            storage = packIndices(index_data, count, index_type);
+            return storage.data();
+        }
 
-                // UV (optional)
-                if (uvs && uvs->size() >= i * 2 + 2)
-                {
-                    interleaved_vertices.push_back((*uvs)[i * 2 + 0]);
-                    interleaved_vertices.push_back((*uvs)[i * 2 + 1]);
-                }
-            }
+        // Uploads 32 bit indices with the smallest index type that fits
+        void uploadNarrowed(const std::vector<VertexStream>& streams, const unsigned int* index_data, size_t count)
+        {
+            std::vector<unsigned char> storage;
+            size_t bytes = 0;
+            const void* data = narrowIndices(index_data, count, storage, bytes);
+            upload(streams, data, bytes);
         }
 
-        void setup()
+        // Replaces only the index buffer, the vertex buffers stay as they are
+        void uploadIndices(const unsigned int* index_data, size_t count)
         {
-            interleave();
-            
-            glGenVertexArrays(1, &VAO);
-            glGenBuffers(1, &VBO);
-            glGenBuffers(1, &EBO);
+            std::vector<unsigned char> storage;
+            size_t bytes = 0;
+            const void* data = narrowIndices(index_data, count, storage, bytes);
 
-            glBindVertexArray(VAO);
+            GLState::shared().bindVertexArray(VAO);
+            GLState::shared().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+            GLState::shared().bindVertexArray(0);
+        }
 
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, interleaved_vertices.size() * sizeof(float), interleaved_vertices.data(), GL_STATIC_DRAW);
-            
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices->size() * sizeof(unsigned int), indices->data(), GL_STATIC_DRAW);
+        void forgetBuffers()
+        {
+            for (GLuint buffer : VBOs)
+                GLState::shared().forgetBuffer(buffer);
+        }
 
-            // Layout
-            int offset = 0;
+        void upload(const std::vector<VertexStream>& streams, const void* index_data, size_t index_bytes)
+        {
+            // Buffers are reused when the mesh is uploaded again
+            if (VAO == 0) glGenVertexArrays(1, &VAO);
+            if (EBO == 0) glGenBuffers(1, &EBO);
+            if (VBOs.size() != streams.size())
+            {
+                forgetBuffers();
+                glDeleteBuffers(static_cast<GLsizei>(VBOs.size()), VBOs.data());
+                VBOs.resize(streams.size());
+                glGenBuffers(static_cast<GLsizei>(VBOs.size()), VBOs.data());
+            }
 
-            // Position (location = 0)
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertex_stride * sizeof(float), (void*)(offset * sizeof(float)));
-            glEnableVertexAttribArray(0);
-            offset += 3;
+            GLState::shared().bindVertexArray(VAO);
 
-            // Color (location = 1)
-            if (colors)
+            GLState::shared().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, index_data, GL_STATIC_DRAW);
+
+            // Layout: position (location = 0), color (location = 1), uv (location = 2), normal (location = 3)
+            for (size_t i = 0; i < streams.size(); i++)
             {
-                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vertex_stride * sizeof(float), (void*)(offset * sizeof(float)));
-                glEnableVertexAttribArray(1);
-                offset += 3;
+                const VertexStream& stream = streams[i];
+                GLState::shared().bindBuffer(GL_ARRAY_BUFFER, VBOs[i]);
+                glBufferData(GL_ARRAY_BUFFER, stream.size, stream.data, GL_STATIC_DRAW);
+
+                for (const VertexAttribute& attribute : stream.attributes)
+                {
+                    glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                          stream.stride, (void*)(size_t)attribute.offset);
+                    glEnableVertexAttribArray(attribute.location);
+                }
             }
 
-            // UV (location = 2)
-            if (uvs)
+            // Constant attributes are read from the current attribute value instead
+            for (const ConstantAttribute& constant : constants)
             {
-                glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, vertex_stride * sizeof(float), (void*)(offset * sizeof(float)));
-                glEnableVertexAttribArray(2);
-                offset += 2;
+                glDisableVertexAttribArray(constant.location);
             }
 
             // glBindBuffer(GL_ARRAY_BUFFER, 0);
-            glBindVertexArray(0);
+            GLState::shared().bindVertexArray(0);
         }
 
     public:
         Mesh(std::shared_ptr<std::vector<float>> positions,
              std::shared_ptr<std::vector<unsigned int>> indices,
              std::shared_ptr<std::vector<float>> colors = nullptr,
-             std::shared_ptr<std::vector<float>> uvs = nullptr)
-        : positions(positions), indices(indices), colors(colors), uvs(uvs)
+             std::shared_ptr<std::vector<float>> uvs = nullptr,
+             std::shared_ptr<std::vector<float>> normals = nullptr,
+             const VertexLayout& layout = VertexLayout())
+        : positions(positions), colors(colors), uvs(uvs), normals(normals), indices(indices), layout(layout)
         {
             num_vertices = static_cast<unsigned int>(positions->size() / 3);
             num_indices = static_cast<unsigned int>(indices->size());
             setup();
         }
 
+        // Uploads already packed vertex and index data straight into the GL
+        // buffers. No CPU side copy is kept, so the getters for the separate
+        // streams return nullptr for meshes created this way.
+        Mesh(const void* vertex_data, unsigned int num_vertices, const PackedVertexLayout& vertex_layout,
+             const void* index_data, unsigned int num_indices, GLenum index_type = GL_UNSIGNED_INT)
+        : num_vertices(num_vertices), num_indices(num_indices), index_type(index_type)
+        {
+            setLayout(vertex_layout);
+            lods = {{0, num_indices, 0.0f}};
+            upload({{vertex_data, static_cast<size_t>(num_vertices) * vertex_stride, vertex_stride, attributes}},
+                   index_data, static_cast<size_t>(num_indices) * indexTypeSize(index_type));
+        }
+
+        // Same as above, but every stream gets its own vertex buffer, which
+        // lets separate or differently strided source buffers be uploaded as is.
+        Mesh(const std::vector<VertexStream>& streams, unsigned int num_vertices,
+             const unsigned int* index_data, unsigned int num_indices)
+        : num_vertices(num_vertices), num_indices(num_indices)
+        {
+            for (const VertexStream& stream : streams)
+            {
+                attributes.insert(attributes.end(), stream.attributes.begin(), stream.attributes.end());
+            }
+            vertex_stride = streams.empty() ? 0 : streams.front().stride;
+            lods = {{0, num_indices, 0.0f}};
+            uploadNarrowed(streams, index_data, num_indices);
+        }
+
+        // Same as above with indices that are already in their final type
+        Mesh(const std::vector<VertexStream>& streams, unsigned int num_vertices,
+             const void* index_data, unsigned int num_indices, GLenum index_type)
+        : num_vertices(num_vertices), num_indices(num_indices), index_type(index_type)
+        {
+            for (const VertexStream& stream : streams)
+            {
+                attributes.insert(attributes.end(), stream.attributes.begin(), stream.attributes.end());
+            }
+            vertex_stride = streams.empty() ? 0 : streams.front().stride;
+            lods = {{0, num_indices, 0.0f}};
+            upload(streams, index_data, static_cast<size_t>(num_indices) * indexTypeSize(index_type));
+        }
+
         ~Mesh()
         {
-            glDeleteBuffers(1, &VBO);
+            forgetBuffers();
+            GLState::shared().forgetBuffer(EBO);
+            GLState::shared().forgetVertexArray(VAO);
+            glDeleteBuffers(static_cast<GLsizei>(VBOs.size()), VBOs.data());
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
         }
 
-        void bind() { glBindVertexArray(VAO); }
-        void unbind() { glBindVertexArray(0); }
+        Mesh(const Mesh&) = delete;
+        Mesh& operator=(const Mesh&) = delete;
+
+        Mesh(Mesh&& other) noexcept
+        {
+            swap(other);
+        }
+
+        // Takes over the buffers of other, e.g. a mesh loaded again from its
+        // file, so everyone holding this mesh draws the new data. The old
+        // buffers are deleted with other.
+        Mesh& operator=(Mesh&& other) noexcept
+        {
+            if (this != &other)
+                swap(other);
+            return *this;
+        }
+
+        void swap(Mesh& other) noexcept
+        {
+            std::swap(positions, other.positions);
+            std::swap(colors, other.colors);
+            std::swap(uvs, other.uvs);
+            std::swap(normals, other.normals);
+            std::swap(indices, other.indices);
+            std::swap(layout, other.layout);
+            std::swap(attributes, other.attributes);
+            std::swap(constants, other.constants);
+            std::swap(vertex_stride, other.vertex_stride);
+            std::swap(position_offset, other.position_offset);
+            std::swap(position_scale, other.position_scale);
+            std::swap(num_vertices, other.num_vertices);
+            std::swap(num_indices, other.num_indices);
+            std::swap(index_type, other.index_type);
+            std::swap(lods, other.lods);
+            std::swap(lod_options, other.lod_options);
+            std::swap(meshlets, other.meshlets);
+            std::swap(meshlet_options, other.meshlet_options);
+            std::swap(bounds, other.bounds);
+            std::swap(bounds_center, other.bounds_center);
+            std::swap(bounds_radius, other.bounds_radius);
+            std::swap(EBO, other.EBO);
+            std::swap(VAO, other.VAO);
+            std::swap(VBOs, other.VBOs);
+        }
+
+        // Reorders indices and vertices for the post-transform cache (and
+        // optionally overdraw) and uploads the result again. Requires the CPU
+        // side streams, so it is not available for meshes uploaded from raw
+        // data. The streams are modified in place.
+        MeshOptimizeReport optimize(const MeshOptimizeOptions& options = MeshOptimizeOptions())
+        {
+            if (!positions || !indices)
+            {
+                std::cerr << "Mesh::optimize requires CPU side vertex data" << std::endl;
+                return {};
+            }
+            if (indices->empty())
+                return {};
+
+            MeshOptimizeReport report = MeshOptimizer::optimize(*positions, colors.get(), uvs.get(), normals.get(), *indices, options);
+            num_vertices = static_cast<unsigned int>(positions->size() / 3);
+            num_indices = static_cast<unsigned int>(indices->size());
+
+            // Vertex order changed, so the simplified levels and meshlets are rebuilt
+            bool had_lods = lods.size() > 1;
+            bool had_meshlets = !meshlets.empty();
+            meshlets.clear();
+            setup();
+            // Meshlets reorder the indices the levels are then built from
+            if (had_meshlets)
+                meshlets = MeshletBuilder::build(*positions, *indices, meshlet_options);
+            if (had_lods)
+                generateLods(lod_options);
+            else if (had_meshlets)
+                uploadIndices(indices->data(), indices->size());
+            return report;
+        }
+
+        // Splits the full detail level into meshlets for per cluster culling.
+        // Reorders the CPU side indices and uploads them again, which keeps
+        // plain draws working. Requires the CPU side streams.
+        size_t buildMeshlets(const MeshletOptions& options = MeshletOptions())
+        {
+            if (!positions || !indices)
+            {
+                std::cerr << "Mesh::buildMeshlets requires CPU side vertex data" << std::endl;
+                return 0;
+            }
+
+            meshlet_options = options;
+            meshlets = MeshletBuilder::build(*positions, *indices, options);
+
+            if (lods.size() > 1)
+            {
+                generateLods(lod_options);
+            }
+            else
+            {
+                uploadIndices(indices->data(), indices->size());
+            }
+            return meshlets.size();
+        }
+
+        // Culls the meshlets and fills the draw list with the visible ranges.
+        // model_view_projection and camera_position are in this mesh's object
+        // space (before the quantization transform).
+        void cullMeshlets(const glm::mat4& model_view_projection, const glm::vec3& camera_position,
+                          MeshletDrawList& draws) const
+        {
+            draws.clear();
+            MeshletBuilder::cull(meshlets, Frustum::fromMatrix(model_view_projection), camera_position,
+                                 indexTypeSize(index_type), draws);
+        }
+
+        // Draws the ranges of a draw list, the mesh has to be bound
+        void drawMeshlets(const MeshletDrawList& draws) const
+        {
+            if (draws.counts.empty())
+                return;
+            glMultiDrawElements(GL_TRIANGLES, draws.counts.data(), index_type,
+                                draws.offsets.data(), static_cast<GLsizei>(draws.counts.size()));
+        }
+
+        // Builds a chain of simplified index buffers over the same vertices.
+        // Every level aims for options.reduction times the triangles of the
+        // previous one; generation stops early when the error limit is hit.
+        // Requires the CPU side streams. Returns the number of levels.
+        size_t generateLods(const MeshLodOptions& options = MeshLodOptions())
+        {
+            if (!positions || !indices)
+            {
+                std::cerr << "Mesh::generateLods requires CPU side vertex data" << std::endl;
+                return lods.size();
+            }
+
+            lod_options = options;
+            lods = {{0, num_indices, 0.0f}};
+            std::vector<unsigned int> combined(*indices);
+            float max_error = options.max_error * bounds_radius;
+
+            for (unsigned int level = 1; level < options.max_levels; level++)
+            {
+                size_t previous = lods.back().index_count;
+                size_t target = static_cast<size_t>(previous / 3 * options.reduction) * 3;
+
+                float error = 0.0f;
+                std::vector<unsigned int> lod = MeshSimplifier::simplify(*positions, *indices, target, max_error, &error);
+                // Not worth a level of its own
+                if (lod.empty() || lod.size() > previous * 9 / 10)
+                    break;
+
+                MeshOptimizer::optimizeVertexCache(lod, num_vertices);
+                lods.push_back({static_cast<unsigned int>(combined.size()), static_cast<unsigned int>(lod.size()),
+                                std::max(error, lods.back().error)});
+                combined.insert(combined.end(), lod.begin(), lod.end());
+            }
+
+            uploadIndices(combined.data(), combined.size());
+            return lods.size();
+        }
+
+        // Coarsest level whose error stays below max_screen_error once scaled
+        // by screen_scale (screen units per object space unit at the mesh)
+        size_t selectLod(float screen_scale, float max_screen_error) const
+        {
+            size_t level = 0;
+            while (level + 1 < lods.size() && lods[level + 1].error * screen_scale <= max_screen_error)
+            {
+                level++;
+            }
+            return level;
+        }
+
+        VertexCacheStatistics analyzeVertexCache(unsigned int cache_size = 16) const
+        {
+            if (!indices)
+                return {};
+            return MeshOptimizer::analyzeVertexCache(*indices, num_vertices, cache_size);
+        }
+
+        void bind()
+        {
+            GLState::shared().bindVertexArray(VAO);
+            bindConstants();
+        }
+        void unbind() { GLState::shared().bindVertexArray(0); }
+
+        // The current attribute value is context state, not VAO state, so it
+        // has to be set again whenever the mesh is bound.
+        void bindConstants() const
+        {
+            for (const ConstantAttribute& constant : constants)
+            {
+                glVertexAttrib4fv(constant.location, &constant.value[0]);
+            }
+        }
+
+        // Overrides an attribute with one value for every vertex. Used for
+        // streams that are not present in the source data.
+        void setConstantAttribute(GLuint location, const glm::vec4& value)
+        {
+            for (const VertexAttribute& attribute : attributes)
+            {
+                if (attribute.location == location)
+                    return;
+            }
+            for (ConstantAttribute& constant : constants)
+            {
+                if (constant.location == location)
+                {
+                    constant.value = value;
+                    return;
+                }
+            }
+            constants.push_back({location, value});
+        }
 
-        void draw() const
+        void draw(size_t lod = 0) const
         {
-            glBindVertexArray(VAO);
-            if (indices && !indices->empty())
+            GLState::shared().bindVertexArray(VAO);
+            bindConstants();
+            if (num_indices > 0)
             {
-                glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, 0);
+                drawElements(lod);
             }
             else
             {
                 glDrawArrays(GL_TRIANGLES, 0, num_vertices);
             }
-            glBindVertexArray(0);
+        }
+
+        // Issues the draw call for one level, the mesh has to be bound
+        void drawElements(size_t lod = 0) const
+        {
+            const MeshLod& range = lods[std::min(lod, lods.size() - 1)];
+            glDrawElements(GL_TRIANGLES, range.index_count, index_type,
+                           (void*)(static_cast<size_t>(range.index_offset) * indexTypeSize(index_type)));
+        }
+
+        // Draws count instances of one level, the mesh has to be bound
+        void drawElementsInstanced(size_t lod, GLsizei count) const
+        {
+            if (num_indices == 0)
+            {
+                glDrawArraysInstanced(GL_TRIANGLES, 0, num_vertices, count);
+                return;
+            }
+            const MeshLod& range = lods[std::min(lod, lods.size() - 1)];
+            glDrawElementsInstanced(GL_TRIANGLES, range.index_count, index_type,
+                                    (void*)(static_cast<size_t>(range.index_offset) * indexTypeSize(index_type)), count);
         }
 
         std::shared_ptr<std::vector<float>> getPositions() const { return positions; }
         std::shared_ptr<std::vector<float>> getColors() const { return colors; }
         std::shared_ptr<std::vector<float>> getUVs() const { return uvs; }
+        std::shared_ptr<std::vector<float>> getNormals() const { return normals; }
         std::shared_ptr<std::vector<unsigned int>> getIndices() const { return indices; }
 
+        const std::vector<VertexAttribute>& getAttributes() const { return attributes; }
+        const std::vector<ConstantAttribute>& getConstantAttributes() const { return constants; }
+        GLsizei getVertexStride() const { return vertex_stride; }
+        GLuint getVertexArray() const { return VAO; }
+        const VertexLayout& getLayout() const { return layout; }
+
+        bool hasQuantizedPositions() const
+        {
+            return position_offset != glm::vec3(0.0f) || position_scale != glm::vec3(1.0f);
+        }
+
+        // Maps the stored (normalized) positions back to object space. Apply
+        // it to the model matrix when hasQuantizedPositions() is true.
+        glm::mat4 getPositionTransform() const
+        {
+            return glm::scale(glm::translate(glm::mat4(1.0f), position_offset), position_scale);
+        }
+
         unsigned int getNumVertices() const { return num_vertices; }
         unsigned int getNumIndices() const { return num_indices; }
+        // GL type of the index buffer, pass it to glDrawElements
+        GLenum getIndexType() const { return index_type; }
+
+        size_t getLodCount() const { return lods.size(); }
+        const std::vector<Meshlet>& getMeshlets() const { return meshlets; }
+        bool hasMeshlets() const { return !meshlets.empty(); }
+        const MeshLod& getLod(size_t level) const { return lods[level]; }
+
+        // Object space bounding sphere, only known for meshes with CPU data
+        const glm::vec3& getBoundsCenter() const { return bounds_center; }
+        float getBoundsRadius() const { return bounds_radius; }
+        // Object space box and sphere, empty for meshes without CPU data
+        // unless set by hand
+        const Bounds& getBounds() const { return bounds; }
+
+        void setBounds(const Bounds& new_bounds)
+        {
+            bounds = new_bounds;
+            bounds_center = bounds.center;
+            bounds_radius = bounds.radius;
+        }
     };
-}
\ No newline at end of file
+}
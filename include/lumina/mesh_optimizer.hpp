@@ -0,0 +1,457 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace lumina
+{
+    struct VertexCacheStatistics
+    {
+        unsigned int vertices_transformed = 0;
+        float acmr = 0.0f; // average cache miss ratio: transformed vertices per triangle
+        float atvr = 0.0f; // average transformed vertex ratio: transformed vertices per vertex
+    };
+
+    struct MeshOptimizeOptions
+    {
+        bool vertex_cache = true;
+        bool overdraw = false;
+        bool vertex_fetch = true;
+        // Overdraw ordering may increase ACMR by at most this factor
+        float overdraw_threshold = 1.05f;
+    };
+
+    struct MeshOptimizeReport
+    {
+        VertexCacheStatistics before;
+        VertexCacheStatistics after;
+    };
+
+    // Index and vertex reordering for better post-transform cache use,
+    // less overdraw and more linear vertex fetches. All passes work on
+    // triangle lists and keep the set of triangles unchanged.
+    class MeshOptimizer
+    {
+        public:
+        // Simulates a FIFO post-transform cache of the given size
+        static VertexCacheStatistics analyzeVertexCache(const std::vector<unsigned int>& indices,
+                                                        size_t num_vertices,
+                                                        unsigned int cache_size = 16)
+        {
+            VertexCacheStatistics stats;
+            if (indices.empty() || num_vertices == 0)
+                return stats;
+
+            std::vector<unsigned int> timestamps(num_vertices, 0);
+            unsigned int time = cache_size + 1;
+            for (unsigned int index : indices)
+            {
+                if (index >= num_vertices)
+                    continue;
+                if (time - timestamps[index] > cache_size)
+                {
+                    timestamps[index] = time++;
+                    stats.vertices_transformed++;
+                }
+            }
+
+            stats.acmr = static_cast<float>(stats.vertices_transformed) / static_cast<float>(indices.size() / 3);
+            stats.atvr = static_cast<float>(stats.vertices_transformed) / static_cast<float>(num_vertices);
+            return stats;
+        }
+
+        // Tom Forsyth's linear-speed vertex cache optimisation
+        static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t num_vertices)
+        {
+            const size_t num_triangles = indices.size() / 3;
+            if (num_triangles == 0)
+                return;
+
+            // Vertex to triangle adjacency
+            std::vector<unsigned int> remaining(num_vertices, 0);
+            for (size_t i = 0; i < num_triangles * 3; i++)
+                remaining[indices[i]]++;
+
+            std::vector<unsigned int> offsets(num_vertices + 1, 0);
+            for (size_t v = 0; v < num_vertices; v++)
+                offsets[v + 1] = offsets[v] + remaining[v];
+
+            std::vector<unsigned int> adjacency(num_triangles * 3);
+            {
+                std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t t = 0; t < num_triangles; t++)
+                    for (size_t k = 0; k < 3; k++)
+                        adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+            }
+
+            std::vector<int> cache_position(num_vertices, -1);
+            std::vector<float> vertex_score(num_vertices);
+            for (size_t v = 0; v < num_vertices; v++)
+                vertex_score[v] = scoreVertex(-1, remaining[v]);
+
+            std::vector<float> triangle_score(num_triangles);
+            std::vector<uint8_t> emitted(num_triangles, 0);
+            for (size_t t = 0; t < num_triangles; t++)
+            {
+                triangle_score[t] = vertex_score[indices[t * 3 + 0]] +
+                                    vertex_score[indices[t * 3 + 1]] +
+                                    vertex_score[indices[t * 3 + 2]];
+            }
+
+            std::vector<unsigned int> output;
+            output.reserve(num_triangles * 3);
+
+            unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+            size_t cache_count = 0;
+            size_t scan = 0;
+            long best = -1;
+
+            for (size_t emitted_count = 0; emitted_count < num_triangles; emitted_count++)
+            {
+                if (best < 0)
+                {
+                    // Nothing in the cache is adjacent to anything left, restart
+                    float best_score = -1.0f;
+                    while (scan < num_triangles && emitted[scan]) scan++;
+                    for (size_t t = scan; t < num_triangles && t < scan + 64; t++)
+                    {
+                        if (!emitted[t] && triangle_score[t] > best_score)
+                        {
+                            best_score = triangle_score[t];
+                            best = static_cast<long>(t);
+                        }
+                    }
+                }
+
+                const unsigned int* triangle = &indices[best * 3];
+                output.insert(output.end(), triangle, triangle + 3);
+                emitted[best] = 1;
+
+                // Remove the triangle from the adjacency of its vertices
+                for (size_t k = 0; k < 3; k++)
+                {
+                    unsigned int v = triangle[k];
+                    unsigned int* begin = &adjacency[offsets[v]];
+                    unsigned int* end = begin + remaining[v];
+                    unsigned int* it = std::find(begin, end, static_cast<unsigned int>(best));
+                    if (it != end)
+                    {
+                        *it = *(end - 1);
+                        remaining[v]--;
+                    }
+                }
+
+                // Move the triangle vertices to the front of the LRU cache
+                unsigned int new_cache[FORSYTH_CACHE_SIZE + 3];
+                size_t new_count = 0;
+                for (size_t k = 0; k < 3; k++)
+                    new_cache[new_count++] = triangle[k];
+                for (size_t i = 0; i < cache_count; i++)
+                {
+                    unsigned int v = cache[i];
+                    if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                        new_cache[new_count++] = v;
+                }
+
+                // Vertices pushed out of the cache
+                for (size_t i = FORSYTH_CACHE_SIZE; i < new_count; i++)
+                {
+                    cache_position[new_cache[i]] = -1;
+                    vertex_score[new_cache[i]] = scoreVertex(-1, remaining[new_cache[i]]);
+                }
+                new_count = std::min<size_t>(new_count, FORSYTH_CACHE_SIZE);
+
+                for (size_t i = 0; i < new_count; i++)
+                {
+                    cache[i] = new_cache[i];
+                    cache_position[cache[i]] = static_cast<int>(i);
+                    vertex_score[cache[i]] = scoreVertex(static_cast<int>(i), remaining[cache[i]]);
+                }
+                cache_count = new_count;
+
+                // Rescore the triangles touching the cache and pick the best one
+                best = -1;
+                float best_score = 0.0f;
+                for (size_t i = 0; i < cache_count; i++)
+                {
+                    unsigned int v = cache[i];
+                    for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; a++)
+                    {
+                        unsigned int t = adjacency[a];
+                        float score = vertex_score[indices[t * 3 + 0]] +
+                                      vertex_score[indices[t * 3 + 1]] +
+                                      vertex_score[indices[t * 3 + 2]];
+                        triangle_score[t] = score;
+                        if (score > best_score)
+                        {
+                            best_score = score;
+                            best = static_cast<long>(t);
+                        }
+                    }
+                }
+            }
+
+            indices.swap(output);
+        }
+
+        // Reorders clusters of the (already cache optimised) index buffer so
+        // that outward facing parts of the mesh are drawn first.
+        static void optimizeOverdraw(std::vector<unsigned int>& indices,
+                                     const std::vector<float>& positions,
+                                     float threshold = 1.05f,
+                                     unsigned int cache_size = 16)
+        {
+            const size_t num_triangles = indices.size() / 3;
+            const size_t num_vertices = positions.size() / 3;
+            if (num_triangles < 2)
+                return;
+
+            std::vector<size_t> clusters = findClusters(indices, num_vertices, threshold, cache_size);
+
+            // Mesh centroid
+            double mesh_centroid[3] = {0.0, 0.0, 0.0};
+            for (size_t v = 0; v < num_vertices; v++)
+                for (size_t k = 0; k < 3; k++)
+                    mesh_centroid[k] += positions[v * 3 + k];
+            for (size_t k = 0; k < 3; k++)
+                mesh_centroid[k] /= static_cast<double>(std::max<size_t>(num_vertices, 1));
+
+            struct Cluster
+            {
+                size_t begin;
+                size_t end;
+                float sort_key;
+            };
+            std::vector<Cluster> sorted;
+            sorted.reserve(clusters.size());
+
+            for (size_t c = 0; c < clusters.size(); c++)
+            {
+                size_t begin = clusters[c];
+                size_t end = c + 1 < clusters.size() ? clusters[c + 1] : num_triangles;
+
+                double centroid[3] = {0.0, 0.0, 0.0};
+                double normal[3] = {0.0, 0.0, 0.0};
+                double area_sum = 0.0;
+                for (size_t t = begin; t < end; t++)
+                {
+                    const float* a = &positions[indices[t * 3 + 0] * 3];
+                    const float* b = &positions[indices[t * 3 + 1] * 3];
+                    const float* p = &positions[indices[t * 3 + 2] * 3];
+                    double e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+                    double e2[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+                    double n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                                   e1[2] * e2[0] - e1[0] * e2[2],
+                                   e1[0] * e2[1] - e1[1] * e2[0]};
+                    double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    for (size_t k = 0; k < 3; k++)
+                    {
+                        centroid[k] += (a[k] + b[k] + p[k]) / 3.0 * area;
+                        normal[k] += n[k];
+                    }
+                    area_sum += area;
+                }
+
+                double normal_length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                float key = 0.0f;
+                if (area_sum > 0.0 && normal_length > 0.0)
+                {
+                    double dot = 0.0;
+                    for (size_t k = 0; k < 3; k++)
+                        dot += (centroid[k] / area_sum - mesh_centroid[k]) * normal[k] / normal_length;
+                    key = static_cast<float>(dot);
+                }
+                sorted.push_back({begin, end, key});
+            }
+
+            std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+                return a.sort_key > b.sort_key;
+            });
+
+            std::vector<unsigned int> output;
+            output.reserve(indices.size());
+            for (const Cluster& cluster : sorted)
+                output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+            indices.swap(output);
+        }
+
+        // Renumbers vertices in order of first use so vertex fetches become
+        // mostly linear. Unreferenced vertices are dropped. Returns the remap
+        // table (old index -> new index, ~0u for dropped vertices) and the new
+        // vertex count.
+        static size_t optimizeVertexFetchRemap(std::vector<unsigned int>& indices, size_t num_vertices,
+                                               std::vector<unsigned int>& remap)
+        {
+            remap.assign(num_vertices, ~0u);
+            unsigned int next = 0;
+            for (unsigned int& index : indices)
+            {
+                if (remap[index] == ~0u)
+                    remap[index] = next++;
+                index = remap[index];
+            }
+            return next;
+        }
+
+        // Applies a remap table to a vertex stream with width floats per vertex
+        static void remapVertices(std::vector<float>& stream, size_t width,
+                                  const std::vector<unsigned int>& remap, size_t new_count)
+        {
+            if (stream.size() < remap.size() * width)
+                return;
+            std::vector<float> output(new_count * width);
+            for (size_t v = 0; v < remap.size(); v++)
+            {
+                if (remap[v] == ~0u)
+                    continue;
+                std::copy(stream.begin() + v * width, stream.begin() + (v + 1) * width,
+                          output.begin() + remap[v] * width);
+            }
+            stream.swap(output);
+        }
+
+        // Runs the enabled passes over the given streams. Optional streams may be null.
+        static MeshOptimizeReport optimize(std::vector<float>& positions,
+                                           std::vector<float>* colors,
+                                           std::vector<float>* uvs,
+                                           std::vector<float>* normals,
+                                           std::vector<unsigned int>& indices,
+                                           const MeshOptimizeOptions& options = MeshOptimizeOptions())
+        {
+            MeshOptimizeReport report;
+            size_t num_vertices = positions.size() / 3;
+
+            // Non-indexed meshes are drawn in vertex order, there is nothing
+            // to reorder and the fetch pass would drop every vertex
+            if (indices.empty())
+                return report;
+
+            for (unsigned int index : indices)
+            {
+                if (index >= num_vertices)
+                {
+                    report.before = report.after = analyzeVertexCache(indices, num_vertices);
+                    return report;
+                }
+            }
+
+            report.before = analyzeVertexCache(indices, num_vertices);
+
+            if (options.vertex_cache)
+                optimizeVertexCache(indices, num_vertices);
+
+            if (options.overdraw)
+                optimizeOverdraw(indices, positions, options.overdraw_threshold);
+
+            if (options.vertex_fetch)
+            {
+                std::vector<unsigned int> remap;
+                size_t new_count = optimizeVertexFetchRemap(indices, num_vertices, remap);
+                remapVertices(positions, 3, remap, new_count);
+                if (colors) remapVertices(*colors, 3, remap, new_count);
+                if (uvs) remapVertices(*uvs, 2, remap, new_count);
+                if (normals) remapVertices(*normals, 3, remap, new_count);
+                num_vertices = new_count;
+            }
+
+            report.after = analyzeVertexCache(indices, num_vertices);
+            return report;
+        }
+
+        private:
+        static constexpr size_t FORSYTH_CACHE_SIZE = 32;
+
+        static float scoreVertex(int cache_position, unsigned int remaining)
+        {
+            if (remaining == 0)
+                return -1.0f;
+
+            float score = 0.0f;
+            if (cache_position >= 0)
+            {
+                if (cache_position < 3)
+                {
+                    // The vertices of the last triangle get a fixed score
+                    score = 0.75f;
+                }
+                else
+                {
+                    const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                    score = std::pow(1.0f - (cache_position - 3) * scaler, 1.5f);
+                }
+            }
+
+            // Boost vertices with few triangles left so they are finished off
+            score += 2.0f / std::sqrt(static_cast<float>(remaining));
+            return score;
+        }
+
+        // Cluster start triangles. Hard boundaries are where the cache order
+        // restarts (all three vertices miss); hard clusters are split further
+        // wherever the running ACMR stays within threshold of the cluster ACMR.
+        static std::vector<size_t> findClusters(const std::vector<unsigned int>& indices, size_t num_vertices,
+                                                float threshold, unsigned int cache_size)
+        {
+            const size_t num_triangles = indices.size() / 3;
+            std::vector<unsigned int> timestamps(num_vertices, 0);
+            unsigned int time = cache_size + 1;
+
+            auto misses = [&](size_t t) {
+                unsigned int count = 0;
+                for (size_t k = 0; k < 3; k++)
+                {
+                    unsigned int v = indices[t * 3 + k];
+                    if (time - timestamps[v] > cache_size)
+                    {
+                        timestamps[v] = time++;
+                        count++;
+                    }
+                }
+                return count;
+            };
+            auto flush = [&]() { time += cache_size + 1; };
+
+            std::vector<size_t> hard;
+            for (size_t t = 0; t < num_triangles; t++)
+            {
+                if (misses(t) == 3)
+                    hard.push_back(t);
+            }
+            if (hard.empty() || hard.front() != 0)
+                hard.insert(hard.begin(), 0);
+
+            std::vector<size_t> clusters;
+            for (size_t h = 0; h < hard.size(); h++)
+            {
+                size_t begin = hard[h];
+                size_t end = h + 1 < hard.size() ? hard[h + 1] : num_triangles;
+
+                flush();
+                unsigned int cluster_misses = 0;
+                for (size_t t = begin; t < end; t++)
+                    cluster_misses += misses(t);
+                float cluster_acmr = static_cast<float>(cluster_misses) / static_cast<float>(end - begin);
+
+                flush();
+                clusters.push_back(begin);
+                size_t soft_begin = begin;
+                unsigned int running = 0;
+                for (size_t t = begin; t < end; t++)
+                {
+                    running += misses(t);
+                    size_t count = t - soft_begin + 1;
+                    if (t + 1 < end && static_cast<float>(running) / static_cast<float>(count) <= cluster_acmr * threshold)
+                    {
+                        clusters.push_back(t + 1);
+                        soft_begin = t + 1;
+                        running = 0;
+                        flush();
+                    }
+                }
+            }
+            return clusters;
+        }
+    };
+}
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace lumina
+{
+    struct MeshLodOptions
+    {
+        unsigned int max_levels = 4;   // including the full detail level
+        float reduction = 0.5f;        // triangle ratio between consecutive levels
+        float max_error = 0.05f;       // relative to the mesh bounding radius
+    };
+
+    // Quadric error metric edge collapse simplification (Garland & Heckbert).
+    //
+    // Vertices are only ever collapsed onto other existing vertices, so every
+    // simplified index buffer stays valid for the original vertex buffer and
+    // LODs can share it. Vertices that share a position but differ in their
+    // other attributes (uv or normal seams) are locked, border vertices may
+    // only slide along the border.
+    class MeshSimplifier
+    {
+        public:
+        // Simplifies towards target_index_count without exceeding max_error
+        // (object space distance). Returns the simplified index buffer and
+        // stores the reached error in result_error.
+        static std::vector<unsigned int> simplify(const std::vector<float>& positions,
+                                                  const std::vector<unsigned int>& indices,
+                                                  size_t target_index_count,
+                                                  float max_error,
+                                                  float* result_error = nullptr)
+        {
+            const size_t num_vertices = positions.size() / 3;
+            std::vector<unsigned int> result(indices);
+            float reached_error = 0.0f;
+
+            std::vector<unsigned int> wedge = buildPositionRemap(positions, num_vertices);
+            std::vector<VertexKind> kinds(num_vertices, MANIFOLD);
+            std::vector<Quadric> quadrics(num_vertices);
+
+            // Vertices sharing a position with a different vertex are seams
+            for (size_t v = 0; v < num_vertices; v++)
+            {
+                if (wedge[v] != v)
+                {
+                    kinds[v] = LOCKED;
+                    kinds[wedge[v]] = LOCKED;
+                }
+            }
+
+            std::vector<uint64_t> half_edges = buildHalfEdges(result, wedge);
+            for (size_t t = 0; t + 2 < result.size(); t += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int a = result[t + k];
+                    unsigned int b = result[t + (k + 1) % 3];
+                    if (isBorderEdge(half_edges, wedge[a], wedge[b]))
+                    {
+                        if (kinds[a] == MANIFOLD) kinds[a] = BORDER;
+                        if (kinds[b] == MANIFOLD) kinds[b] = BORDER;
+                    }
+                }
+            }
+
+            fillQuadrics(positions, result, wedge, half_edges, quadrics);
+
+            const float max_cost = max_error * max_error;
+            std::vector<unsigned int> collapse_remap(num_vertices);
+            std::vector<char> collapse_locked(num_vertices);
+
+            while (result.size() > target_index_count)
+            {
+                half_edges = buildHalfEdges(result, wedge);
+
+                std::vector<Collapse> collapses;
+                collapses.reserve(result.size());
+                for (size_t t = 0; t + 2 < result.size(); t += 3)
+                {
+                    for (int k = 0; k < 3; k++)
+                    {
+                        unsigned int a = result[t + k];
+                        unsigned int b = result[t + (k + 1) % 3];
+                        bool border = isBorderEdge(half_edges, wedge[a], wedge[b]);
+                        // Interior edges show up twice, keep one of them
+                        if (!border && a > b)
+                            continue;
+                        addCollapse(positions, quadrics, kinds, border, a, b, collapses);
+                    }
+                }
+
+                if (collapses.empty())
+                    break;
+
+                std::sort(collapses.begin(), collapses.end(),
+                          [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+                std::vector<unsigned int> offsets, adjacency;
+                buildAdjacency(result, num_vertices, offsets, adjacency);
+
+                for (size_t v = 0; v < num_vertices; v++)
+                    collapse_remap[v] = static_cast<unsigned int>(v);
+                std::fill(collapse_locked.begin(), collapse_locked.end(), 0);
+
+                // Each collapse removes about two triangles
+                size_t triangles_to_remove = (result.size() - target_index_count) / 3;
+                size_t removed = 0;
+                size_t applied = 0;
+
+                for (const Collapse& collapse : collapses)
+                {
+                    if (collapse.cost > max_cost || removed >= triangles_to_remove)
+                        break;
+                    if (collapse_locked[collapse.from] || collapse_locked[collapse.to])
+                        continue;
+                    if (flipsTriangles(positions, result, offsets, adjacency, collapse.from, collapse.to))
+                        continue;
+
+                    collapse_remap[collapse.from] = collapse.to;
+                    quadrics[collapse.to].add(quadrics[collapse.from]);
+
+                    // The ring around the collapsed vertex changed, so its
+                    // vertices wait for the next pass
+                    for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++)
+                    {
+                        const unsigned int* triangle = &result[adjacency[i] * 3];
+                        collapse_locked[triangle[0]] = 1;
+                        collapse_locked[triangle[1]] = 1;
+                        collapse_locked[triangle[2]] = 1;
+                    }
+                    collapse_locked[collapse.to] = 1;
+
+                    reached_error = std::max(reached_error, collapse.cost);
+                    removed += kinds[collapse.from] == BORDER ? 1 : 2;
+                    applied++;
+                }
+
+                if (applied == 0)
+                    break;
+
+                size_t write = 0;
+                for (size_t t = 0; t + 2 < result.size(); t += 3)
+                {
+                    unsigned int a = collapse_remap[result[t + 0]];
+                    unsigned int b = collapse_remap[result[t + 1]];
+                    unsigned int c = collapse_remap[result[t + 2]];
+                    if (a == b || b == c || c == a)
+                        continue;
+                    result[write++] = a;
+                    result[write++] = b;
+                    result[write++] = c;
+                }
+                result.resize(write);
+            }
+
+            if (result_error)
+                *result_error = std::sqrt(reached_error);
+            return result;
+        }
+
+        private:
+        enum VertexKind : unsigned char
+        {
+            MANIFOLD,
+            BORDER,
+            LOCKED
+        };
+
+        // Symmetric 4x4 plane quadric, stored as its upper triangle
+        struct Quadric
+        {
+            double a2 = 0, b2 = 0, c2 = 0, d2 = 0;
+            double ab = 0, ac = 0, ad = 0, bc = 0, bd = 0, cd = 0;
+            double weight = 0;
+
+            void addPlane(double a, double b, double c, double d, double w)
+            {
+                a2 += a * a * w; b2 += b * b * w; c2 += c * c * w; d2 += d * d * w;
+                ab += a * b * w; ac += a * c * w; ad += a * d * w;
+                bc += b * c * w; bd += b * d * w; cd += c * d * w;
+                weight += w;
+            }
+
+            void add(const Quadric& q)
+            {
+                a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+                ab += q.ab; ac += q.ac; ad += q.ad;
+                bc += q.bc; bd += q.bd; cd += q.cd;
+                weight += q.weight;
+            }
+
+            // Weighted squared distance of p to the accumulated planes
+            double error(const float* p) const
+            {
+                double x = p[0], y = p[1], z = p[2];
+                double rx = a2 * x + ab * y + ac * z + ad;
+                double ry = ab * x + b2 * y + bc * z + bd;
+                double rz = ac * x + bc * y + c2 * z + cd;
+                double rw = ad * x + bd * y + cd * z + d2;
+                return std::fabs(rx * x + ry * y + rz * z + rw);
+            }
+        };
+
+        struct Collapse
+        {
+            unsigned int from;
+            unsigned int to;
+            float cost; // squared distance
+        };
+
+        // Border constraints are weighted heavily so borders hold their shape
+        static constexpr double BORDER_WEIGHT = 10.0;
+
+        static std::vector<unsigned int> buildPositionRemap(const std::vector<float>& positions, size_t num_vertices)
+        {
+            struct Key
+            {
+                float p[3];
+                bool operator==(const Key& other) const { return std::memcmp(p, other.p, sizeof(p)) == 0; }
+            };
+            struct KeyHash
+            {
+                size_t operator()(const Key& key) const
+                {
+                    uint32_t h[3];
+                    std::memcpy(h, key.p, sizeof(h));
+                    return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+                }
+            };
+
+            std::unordered_map<Key, unsigned int, KeyHash> first;
+            first.reserve(num_vertices);
+            std::vector<unsigned int> remap(num_vertices);
+            for (size_t v = 0; v < num_vertices; v++)
+            {
+                Key key{{positions[v * 3 + 0], positions[v * 3 + 1], positions[v * 3 + 2]}};
+                remap[v] = first.emplace(key, static_cast<unsigned int>(v)).first->second;
+            }
+            return remap;
+        }
+
+        static uint64_t edgeKey(unsigned int a, unsigned int b)
+        {
+            return (static_cast<uint64_t>(a) << 32) | b;
+        }
+
+        // Sorted list of directed edges in position space
+        static std::vector<uint64_t> buildHalfEdges(const std::vector<unsigned int>& indices,
+                                                    const std::vector<unsigned int>& wedge)
+        {
+            std::vector<uint64_t> edges;
+            edges.reserve(indices.size());
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    edges.push_back(edgeKey(wedge[indices[t + k]], wedge[indices[t + (k + 1) % 3]]));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            return edges;
+        }
+
+        // An edge is on the border when no triangle walks it the other way
+        static bool isBorderEdge(const std::vector<uint64_t>& half_edges, unsigned int a, unsigned int b)
+        {
+            return !std::binary_search(half_edges.begin(), half_edges.end(), edgeKey(b, a));
+        }
+
+        static void fillQuadrics(const std::vector<float>& positions,
+                                 const std::vector<unsigned int>& indices,
+                                 const std::vector<unsigned int>& wedge,
+                                 const std::vector<uint64_t>& half_edges,
+                                 std::vector<Quadric>& quadrics)
+        {
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                const float* p[3] = {&positions[indices[t] * 3], &positions[indices[t + 1] * 3], &positions[indices[t + 2] * 3]};
+
+                double e1[3], e2[3], n[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    e1[k] = p[1][k] - p[0][k];
+                    e2[k] = p[2][k] - p[0][k];
+                }
+                n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+                n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+                n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+                double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length == 0.0)
+                    continue;
+
+                double area = length * 0.5;
+                for (int k = 0; k < 3; k++) n[k] /= length;
+                double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+
+                Quadric plane;
+                plane.addPlane(n[0], n[1], n[2], d, area);
+                for (int k = 0; k < 3; k++)
+                {
+                    quadrics[indices[t + k]].add(plane);
+                }
+
+                // Planes through border edges, perpendicular to the triangle
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int a = indices[t + k];
+                    unsigned int b = indices[t + (k + 1) % 3];
+                    if (!isBorderEdge(half_edges, wedge[a], wedge[b]))
+                        continue;
+
+                    const float* pa = &positions[a * 3];
+                    const float* pb = &positions[b * 3];
+                    double e[3] = {double(pb[0]) - pa[0], double(pb[1]) - pa[1], double(pb[2]) - pa[2]};
+                    double m[3] = {e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0]};
+                    double m_length = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+                    if (m_length == 0.0)
+                        continue;
+                    for (int j = 0; j < 3; j++) m[j] /= m_length;
+                    double md = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+                    double edge_length2 = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+
+                    Quadric border;
+                    border.addPlane(m[0], m[1], m[2], md, edge_length2 * BORDER_WEIGHT);
+                    quadrics[a].add(border);
+                    quadrics[b].add(border);
+                }
+            }
+        }
+
+        static bool canCollapse(VertexKind kind, bool border_edge)
+        {
+            return kind == MANIFOLD || (kind == BORDER && border_edge);
+        }
+
+        static float collapseCost(const std::vector<float>& positions, const std::vector<Quadric>& quadrics,
+                                  unsigned int from, unsigned int to)
+        {
+            const Quadric& q0 = quadrics[from];
+            const Quadric& q1 = quadrics[to];
+            const float* p = &positions[to * 3];
+            double weight = q0.weight + q1.weight;
+            double error = q0.error(p) + q1.error(p);
+            return static_cast<float>(weight > 0.0 ? error / weight : error);
+        }
+
+        static void addCollapse(const std::vector<float>& positions, const std::vector<Quadric>& quadrics,
+                                const std::vector<VertexKind>& kinds, bool border_edge,
+                                unsigned int a, unsigned int b, std::vector<Collapse>& collapses)
+        {
+            bool ab = canCollapse(kinds[a], border_edge);
+            bool ba = canCollapse(kinds[b], border_edge);
+            if (!ab && !ba)
+                return;
+
+            float cost_ab = ab ? collapseCost(positions, quadrics, a, b) : 0.0f;
+            float cost_ba = ba ? collapseCost(positions, quadrics, b, a) : 0.0f;
+            if (ab && (!ba || cost_ab <= cost_ba))
+                collapses.push_back({a, b, cost_ab});
+            else
+                collapses.push_back({b, a, cost_ba});
+        }
+
+        // Vertex to triangle adjacency in CSR form
+        static void buildAdjacency(const std::vector<unsigned int>& indices, size_t num_vertices,
+                                   std::vector<unsigned int>& offsets, std::vector<unsigned int>& adjacency)
+        {
+            offsets.assign(num_vertices + 1, 0);
+            for (unsigned int index : indices)
+                offsets[index + 1]++;
+            for (size_t v = 0; v < num_vertices; v++)
+                offsets[v + 1] += offsets[v];
+
+            std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+            adjacency.resize(indices.size());
+            for (size_t i = 0; i < indices.size(); i++)
+                adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        // True if moving from onto to turns any remaining triangle around
+        static bool flipsTriangles(const std::vector<float>& positions, const std::vector<unsigned int>& indices,
+                                   const std::vector<unsigned int>& offsets, const std::vector<unsigned int>& adjacency,
+                                   unsigned int from, unsigned int to)
+        {
+            for (unsigned int i = offsets[from]; i < offsets[from + 1]; i++)
+            {
+                const unsigned int* triangle = &indices[adjacency[i] * 3];
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                    continue; // collapses away
+
+                Vec3 before[3], after[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    const float* p = &positions[triangle[k] * 3];
+                    const float* q = &positions[(triangle[k] == from ? to : triangle[k]) * 3];
+                    before[k] = {p[0], p[1], p[2]};
+                    after[k] = {q[0], q[1], q[2]};
+                }
+
+                Vec3 n0 = normal(before), n1 = normal(after);
+                double dot = n0.x * n1.x + n0.y * n1.y + n0.z * n1.z;
+                double length0 = std::sqrt(n0.x * n0.x + n0.y * n0.y + n0.z * n0.z);
+                double length1 = std::sqrt(n1.x * n1.x + n1.y * n1.y + n1.z * n1.z);
+                // Flipped or (nearly) degenerate after the collapse
+                if (dot <= 0.25 * length0 * length1)
+                    return true;
+            }
+            return false;
+        }
+
+        struct Vec3
+        {
+            double x, y, z;
+        };
+
+        static Vec3 normal(const Vec3 (&p)[3])
+        {
+            Vec3 e1{p[1].x - p[0].x, p[1].y - p[0].y, p[1].z - p[0].z};
+            Vec3 e2{p[2].x - p[0].x, p[2].y - p[0].y, p[2].z - p[0].z};
+            return {e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x};
+        }
+    };
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+namespace lumina
+{
+    // A small cluster of triangles that is culled as a unit. Its triangles
+    // are stored contiguously in the mesh index buffer.
+    struct Meshlet
+    {
+        unsigned int index_offset;   // in indices
+        unsigned int triangle_count;
+        unsigned int vertex_count;   // unique vertices referenced
+
+        glm::vec3 center;            // object space bounding sphere
+        float radius;
+
+        // Normal cone: the cluster faces away from every viewer for which
+        // dot(center - viewer, cone_axis) >= cone_cutoff * |center - viewer| + radius
+        glm::vec3 cone_axis;
+        float cone_cutoff;           // 1 disables the cone test
+    };
+
+    struct MeshletOptions
+    {
+        unsigned int max_vertices = 64;
+        unsigned int max_triangles = 124;
+    };
+
+    // Ranges of the index buffer left after culling, ready for glMultiDrawElements
+    struct MeshletDrawList
+    {
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;
+        size_t visible = 0;
+        size_t culled = 0;
+
+        void clear()
+        {
+            counts.clear();
+            offsets.clear();
+            visible = 0;
+            culled = 0;
+        }
+    };
+
+    class MeshletBuilder
+    {
+        public:
+        // Groups the triangles into meshlets, growing each one over shared
+        // vertices, and reorders the index buffer so every meshlet is one
+        // contiguous range. The set of triangles is unchanged.
+        static std::vector<Meshlet> build(const std::vector<float>& positions,
+                                          std::vector<unsigned int>& indices,
+                                          const MeshletOptions& options = MeshletOptions())
+        {
+            const size_t num_vertices = positions.size() / 3;
+            const size_t num_triangles = indices.size() / 3;
+            const unsigned int max_vertices = std::max(3u, options.max_vertices);
+            const unsigned int max_triangles = std::max(1u, options.max_triangles);
+
+            // Vertex to triangle adjacency
+            std::vector<unsigned int> offsets(num_vertices + 1, 0);
+            for (unsigned int index : indices)
+                offsets[index + 1]++;
+            for (size_t v = 0; v < num_vertices; v++)
+                offsets[v + 1] += offsets[v];
+            std::vector<unsigned int> adjacency(indices.size());
+            {
+                std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < indices.size(); i++)
+                    adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+            }
+
+            std::vector<char> emitted(num_triangles, 0);
+            // Slot of a vertex in the current meshlet, ~0u when not in it
+            std::vector<unsigned int> used(num_vertices, ~0u);
+
+            std::vector<Meshlet> meshlets;
+            std::vector<unsigned int> ordered;
+            ordered.reserve(indices.size());
+
+            std::vector<unsigned int> meshlet_vertices;
+            std::vector<unsigned int> meshlet_triangles;
+            size_t next_seed = 0;
+
+            auto newVertices = [&](size_t t) {
+                unsigned int count = 0;
+                for (int k = 0; k < 3; k++)
+                    count += used[indices[t * 3 + k]] == ~0u ? 1 : 0;
+                return count;
+            };
+
+            auto flush = [&]() {
+                if (meshlet_triangles.empty())
+                    return;
+                Meshlet meshlet{};
+                meshlet.index_offset = static_cast<unsigned int>(ordered.size());
+                meshlet.triangle_count = static_cast<unsigned int>(meshlet_triangles.size());
+                meshlet.vertex_count = static_cast<unsigned int>(meshlet_vertices.size());
+                for (unsigned int t : meshlet_triangles)
+                {
+                    ordered.insert(ordered.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+                }
+                computeBounds(positions, ordered.data() + meshlet.index_offset, meshlet);
+                meshlets.push_back(meshlet);
+
+                for (unsigned int v : meshlet_vertices)
+                    used[v] = ~0u;
+                meshlet_vertices.clear();
+                meshlet_triangles.clear();
+            };
+
+            while (true)
+            {
+                // Best unemitted triangle around the current meshlet: fewest
+                // new vertices first, then most triangles already touching it
+                long best = -1;
+                unsigned int best_new = 4;
+                for (unsigned int v : meshlet_vertices)
+                {
+                    for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+                    {
+                        unsigned int t = adjacency[i];
+                        if (emitted[t])
+                            continue;
+                        unsigned int extra = newVertices(t);
+                        if (extra < best_new)
+                        {
+                            best = t;
+                            best_new = extra;
+                        }
+                    }
+                }
+
+                bool full = meshlet_triangles.size() >= max_triangles ||
+                            (best >= 0 && meshlet_vertices.size() + best_new > max_vertices);
+                if (best < 0 || full)
+                {
+                    flush();
+                    while (next_seed < num_triangles && emitted[next_seed])
+                        next_seed++;
+                    if (next_seed == num_triangles)
+                        break;
+                    best = static_cast<long>(next_seed);
+                }
+
+                emitted[best] = 1;
+                meshlet_triangles.push_back(static_cast<unsigned int>(best));
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int v = indices[best * 3 + k];
+                    if (used[v] == ~0u)
+                    {
+                        used[v] = static_cast<unsigned int>(meshlet_vertices.size());
+                        meshlet_vertices.push_back(v);
+                    }
+                }
+            }
+            flush();
+
+            indices.swap(ordered);
+            return meshlets;
+        }
+
+        // Culls the meshlets against an object space frustum and normal cones
+        // and appends the visible ones to the draw list. Neighbouring visible
+        // meshlets are merged into a single range.
+        static void cull(const std::vector<Meshlet>& meshlets,
+                         const Frustum& frustum,
+                         const glm::vec3& camera_position,
+                         size_t index_size,
+                         MeshletDrawList& draws)
+        {
+            unsigned int range_begin = 0, range_end = 0;
+            bool open = false;
+
+            for (const Meshlet& meshlet : meshlets)
+            {
+                glm::vec3 to_center = meshlet.center - camera_position;
+                bool backfacing = glm::dot(to_center, meshlet.cone_axis) >=
+                                  meshlet.cone_cutoff * glm::length(to_center) + meshlet.radius;
+
+                if (backfacing || !frustum.intersectsSphere(meshlet.center, meshlet.radius))
+                {
+                    draws.culled++;
+                    continue;
+                }
+                draws.visible++;
+
+                unsigned int begin = meshlet.index_offset;
+                unsigned int end = begin + meshlet.triangle_count * 3;
+                if (open && begin == range_end)
+                {
+                    range_end = end;
+                    continue;
+                }
+                if (open)
+                    addRange(draws, range_begin, range_end, index_size);
+                range_begin = begin;
+                range_end = end;
+                open = true;
+            }
+
+            if (open)
+                addRange(draws, range_begin, range_end, index_size);
+        }
+
+        private:
+        static void addRange(MeshletDrawList& draws, unsigned int begin, unsigned int end, size_t index_size)
+        {
+            draws.counts.push_back(static_cast<GLsizei>(end - begin));
+            draws.offsets.push_back(reinterpret_cast<const void*>(static_cast<size_t>(begin) * index_size));
+        }
+
+        static void computeBounds(const std::vector<float>& positions, const unsigned int* indices, Meshlet& meshlet)
+        {
+            auto position = [&](unsigned int v) {
+                return glm::vec3(positions[v * 3 + 0], positions[v * 3 + 1], positions[v * 3 + 2]);
+            };
+
+            const size_t count = static_cast<size_t>(meshlet.triangle_count) * 3;
+            glm::vec3 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+            for (size_t i = 0; i < count; i++)
+            {
+                min = glm::min(min, position(indices[i]));
+                max = glm::max(max, position(indices[i]));
+            }
+            meshlet.center = (min + max) * 0.5f;
+            meshlet.radius = 0.0f;
+            for (size_t i = 0; i < count; i++)
+            {
+                meshlet.radius = std::max(meshlet.radius, glm::length(position(indices[i]) - meshlet.center));
+            }
+
+            // Cone around the average triangle normal
+            std::vector<glm::vec3> normals;
+            normals.reserve(meshlet.triangle_count);
+            glm::vec3 axis(0.0f);
+            for (size_t i = 0; i < count; i += 3)
+            {
+                glm::vec3 p0 = position(indices[i]), p1 = position(indices[i + 1]), p2 = position(indices[i + 2]);
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float length = glm::length(n);
+                if (length == 0.0f)
+                    continue;
+                normals.push_back(n / length);
+                axis += normals.back();
+            }
+
+            meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+            meshlet.cone_cutoff = 1.0f;
+            float axis_length = glm::length(axis);
+            if (axis_length == 0.0f)
+                return;
+            axis /= axis_length;
+
+            float min_dot = 1.0f;
+            for (const glm::vec3& n : normals)
+                min_dot = std::min(min_dot, glm::dot(n, axis));
+
+            meshlet.cone_axis = axis;
+            // Normals spread over more than a hemisphere cannot all face away
+            if (min_dot > 0.0f)
+                meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+        }
+    };
+}
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <list>
 #include <memory>
+#include <vector>
 
 #include "../libs/glm/glm.hpp"
 #include "../libs/glm/ext/matrix_transform.hpp"
@@ -11,11 +15,29 @@
 #include "mesh.hpp"
 #include "shader.hpp"
 #include "camera.hpp"
+#include "frame_uniforms.hpp"
+#include "frustum.hpp"
+#include "material.hpp"
+#include "render_queue.hpp"
+#include "job_system.hpp"
 
 #include <iostream>
 
 namespace lumina
 {
+    // Transform arrays of a Scene, indexed by Node::scene_index. Node
+    // setters write through to them and record the node as dirty.
+    struct SceneStorage
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> rotations;
+        std::vector<glm::vec3> scales;
+        std::vector<glm::mat4> world_transforms;
+
+        std::vector<uint32_t> dirty;
+        bool structure_changed = false;
+    };
+
     class Node : public std::enable_shared_from_this<Node>
     {
     public:
@@ -30,7 +52,23 @@ namespace lumina
 
         std::shared_ptr<Node> parent;
 
-        glm::mat4 global_transform;
+        glm::mat4 global_transform; // not updated while the node is part of a Scene, see getGlobalTransform()
+
+        // Largest LOD error allowed on screen, as a fraction of the viewport
+        // height (about one pixel at 1080p)
+        float lod_error_threshold = 1.0f / 1080.0f;
+
+        // Optional uniforms on top of the shader
+        std::shared_ptr<Material> material;
+        RenderPass pass = RenderPass::Opaque;
+
+        // Visible meshlet ranges of the last render, kept to reuse the storage
+        MeshletDrawList meshlet_draws;
+
+        // Set while the node is part of a Scene
+        SceneStorage* scene_storage = nullptr;
+        uint32_t scene_index = 0;
+        bool transform_dirty = true;
 
         Node(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, std::shared_ptr<Mesh> mesh, std::shared_ptr<Shader> shader, std::shared_ptr<Camera> camera)
         : position(position), rotation(rotation), scale(scale), mesh(mesh), shader(shader), camera(camera)
@@ -48,26 +86,161 @@ namespace lumina
             }
         }
 
+        // Same as update(), with the child subtrees of the top levels
+        // updated as jobs. Below parallel_depth subtrees run serially.
+        void update(JobSystem& jobs, unsigned int parallel_depth = 4)
+        {
+            JobSystem::Job* group = jobs.createJob(nullptr);
+            updateJob(jobs, group, parallel_depth);
+            jobs.wait(jobs.run(group));
+        }
+
+        // Draws the subtree, skipping meshes outside of the camera frustum
         void render()
         {
-            if (mesh && shader)
+            if (!render_list)
+                render_list = std::make_unique<RenderList>();
+            RenderList& list = *render_list;
+
+            list.nodes.clear();
+            collectDrawable(list.nodes);
+            culling_stats = renderCulled(list.nodes, list.bounds, list.visible, list.queue);
+        }
+
+        // Culls the nodes in world space and draws the visible ones through
+        // the render queue. Every node needs a mesh, a shader and a camera;
+        // runs of nodes with the same camera share one frustum.
+        static CullingStats renderCulled(const std::vector<Node*>& nodes, BoundsBatch& bounds, std::vector<uint8_t>& visible,
+                                         RenderQueue& queue)
+        {
+            CullingStats stats;
+            bounds.clear();
+            bounds.reserve(nodes.size());
+            for (Node* node : nodes)
             {
-                shader->bind();
-                glm::mat4 model = global_transform;
+                bounds.add(node->getWorldBounds());
+            }
+            visible.resize(nodes.size());
+            queue.clear();
+            queue.reserve(nodes.size());
+
+            size_t begin = 0;
+            while (begin < nodes.size())
+            {
+                Camera* camera = nodes[begin]->camera.get();
+                size_t end = begin + 1;
+                while (end < nodes.size() && nodes[end]->camera.get() == camera)
+                    end++;
                 glm::mat4 view = camera->getViewMatrix();
                 glm::mat4 projection = camera->getProjectionMatrix();
-                glUniformMatrix4fv(glGetUniformLocation(shader->shader_id, "model"), 1, GL_FALSE, glm::value_ptr(model));
-                glUniformMatrix4fv(glGetUniformLocation(shader->shader_id, "view"), 1, GL_FALSE, glm::value_ptr(view));
-                glUniformMatrix4fv(glGetUniformLocation(shader->shader_id, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-                mesh->bind();
-                glDrawElements(GL_TRIANGLES, mesh->getNumIndices(), GL_UNSIGNED_INT, 0);
-                mesh->unbind();
-                shader->unbind();
+                bounds.cull(Frustum::fromMatrix(projection * view), begin, end, visible.data(), stats);
+                for (size_t i = begin; i < end; i++)
+                {
+                    if (visible[i])
+                        nodes[i]->enqueue(queue, view, projection);
+                }
+                begin = end;
             }
-            
-            for (auto child : childs)
+
+            queue.sort();
+            queue.submit();
+            return stats;
+        }
+
+        // Adds the draw of this node to a queue. view and projection belong
+        // to the node's camera.
+        void enqueue(RenderQueue& queue, const glm::mat4& view, const glm::mat4& projection)
+        {
+            if (!isDrawable())
+                return;
+            // Shaders still compiling draw with the placeholder, if any
+            Shader* draw_shader = Shader::resolve(shader.get());
+            if (!draw_shader)
+                return;
+
+            const glm::mat4& world = getGlobalTransform();
+            DrawItem item;
+            item.shader = draw_shader;
+            item.material = material.get();
+            item.mesh = mesh.get();
+            item.camera = camera.get();
+            item.model = mesh->hasQuantizedPositions() ? world * mesh->getPositionTransform() : world;
+            item.lod = static_cast<uint32_t>(selectLod(view, projection));
+
+            // Per node cluster lists would break up instanced batches
+            if (item.lod == 0 && mesh->hasMeshlets() && !draw_shader->isInstanced())
             {
-                child->render();
+                glm::mat4 model_view = view * world;
+                glm::vec3 camera_position = glm::vec3(glm::inverse(model_view)[3]);
+                mesh->cullMeshlets(projection * model_view, camera_position, meshlet_draws);
+                item.meshlets = &meshlet_draws;
+            }
+
+            // View space z of the bounds center, from the third row of view
+            glm::vec4 center = world * glm::vec4(mesh->getBoundsCenter(), 1.0f);
+            float depth = -(view[0][2] * center.x + view[1][2] * center.y + view[2][2] * center.z + view[3][2]);
+            queue.add(pass, item, depth);
+        }
+
+        // Draw calls and state changes of the last render()
+        const RenderQueue::Stats& getRenderStats() const
+        {
+            static const RenderQueue::Stats empty;
+            return render_list ? render_list->queue.getStats() : empty;
+        }
+
+        // Visible and culled meshes of the last render()
+        const CullingStats& getCullingStats() const { return culling_stats; }
+
+        // World space bounds of the mesh, empty without one
+        Bounds getWorldBounds() const
+        {
+            return mesh ? mesh->getBounds().transformed(getGlobalTransform()) : Bounds();
+        }
+
+        bool isDrawable() const { return mesh && shader && camera; }
+
+        // Draws only this node, without its children
+        void renderSelf()
+        {
+            Shader* draw_shader = Shader::resolve(shader.get());
+            if (mesh && draw_shader)
+            {
+                draw_shader->bind();
+                const glm::mat4& world = getGlobalTransform();
+                glm::mat4 model = world;
+                if (mesh->hasQuantizedPositions())
+                {
+                    model = model * mesh->getPositionTransform();
+                }
+                glm::mat4 view = camera->getViewMatrix();
+                glm::mat4 projection = camera->getProjectionMatrix();
+                glUniformMatrix4fv(draw_shader->getUniformLocation(BuiltinUniform::Model), 1, GL_FALSE, glm::value_ptr(model));
+                if (draw_shader->usesFrameBlock())
+                {
+                    FrameUniforms::shared().bindCamera(camera.get(), view, projection);
+                }
+                else
+                {
+                    glUniformMatrix4fv(draw_shader->getUniformLocation(BuiltinUniform::View), 1, GL_FALSE, glm::value_ptr(view));
+                    glUniformMatrix4fv(draw_shader->getUniformLocation(BuiltinUniform::Projection), 1, GL_FALSE, glm::value_ptr(projection));
+                }
+                mesh->bind();
+                size_t lod = selectLod(view, projection);
+                if (lod == 0 && mesh->hasMeshlets())
+                {
+                    // Cull the clusters in object space
+                    glm::mat4 model_view = view * world;
+                    glm::vec3 camera_position = glm::vec3(glm::inverse(model_view)[3]);
+                    mesh->cullMeshlets(projection * model_view, camera_position, meshlet_draws);
+                    mesh->drawMeshlets(meshlet_draws);
+                }
+                else
+                {
+                    mesh->drawElements(lod);
+                }
+                if (draw_shader->usesFrameBlock())
+                    FrameUniforms::shared().fence();
             }
         }
 
@@ -75,11 +248,13 @@ namespace lumina
         {
             child->parent = shared_from_this();
             childs.push_back(child);
+            markStructureChanged();
         }
 
         void removeChild(std::shared_ptr<Node> child)
         {
             childs.remove(child);
+            markStructureChanged();
         }
 
         void updateMesh(std::shared_ptr<Mesh> new_mesh)
@@ -87,32 +262,74 @@ namespace lumina
             mesh = std::move(new_mesh);
         }
 
+        // Use the setters instead of writing position, rotation or scale
+        // directly, otherwise a Scene does not notice the change
         void setPosition(glm::vec3 new_position)
         {
             position = new_position;
+            if (scene_storage)
+                scene_storage->positions[scene_index] = new_position;
+            markTransformDirty();
         }
 
         void setRotation(glm::vec3 new_rotation)
         {
             rotation = new_rotation;
+            if (scene_storage)
+                scene_storage->rotations[scene_index] = new_rotation;
+            markTransformDirty();
         }
 
         void setScale(glm::vec3 new_scale)
         {
             scale = new_scale;
+            if (scene_storage)
+                scene_storage->scales[scene_index] = new_scale;
+            markTransformDirty();
         }
 
-        glm::mat4 getLocalTransform()
+        void markTransformDirty()
         {
-            glm::mat4 local_transform = glm::mat4(1.0f);
+            if (transform_dirty)
+                return;
+            transform_dirty = true;
+            if (scene_storage)
+                scene_storage->dirty.push_back(scene_index);
+        }
 
-            local_transform = glm::scale(local_transform, scale);
-            
-            local_transform = glm::rotate(local_transform, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-            local_transform = glm::rotate(local_transform, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-            local_transform = glm::rotate(local_transform, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        void markStructureChanged()
+        {
+            if (scene_storage)
+                scene_storage->structure_changed = true;
+        }
 
-            local_transform = glm::translate(local_transform, position);
+        glm::mat4 getLocalTransform() const
+        {
+            return composeTransform(position, rotation, scale);
+        }
+
+        // World transform, taken from the Scene while the node is part of one
+        const glm::mat4& getGlobalTransform() const
+        {
+            return scene_storage ? scene_storage->world_transforms[scene_index] : global_transform;
+        }
+
+        // scale * rotate_x * rotate_y * rotate_z * translate (rotation in
+        // degrees), written out in closed form instead of chaining glm helpers
+        static glm::mat4 composeTransform(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
+        {
+            glm::vec3 r = glm::radians(rotation);
+            float sa = std::sin(r.x), ca = std::cos(r.x);
+            float sb = std::sin(r.y), cb = std::cos(r.y);
+            float sc = std::sin(r.z), cc = std::cos(r.z);
+
+            glm::mat4 local_transform(1.0f);
+            // local_transform[column][row]
+            local_transform[0] = glm::vec4(scale.x * cb * cc, scale.y * (sa * sb * cc + ca * sc), scale.z * (sa * sc - ca * sb * cc), 0.0f);
+            local_transform[1] = glm::vec4(-scale.x * cb * sc, scale.y * (ca * cc - sa * sb * sc), scale.z * (ca * sb * sc + sa * cc), 0.0f);
+            local_transform[2] = glm::vec4(scale.x * sb, -scale.y * sa * cb, scale.z * ca * cb, 0.0f);
+            local_transform[3] = local_transform[0] * position.x + local_transform[1] * position.y +
+                                 local_transform[2] * position.z + glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
             return local_transform;
         }
@@ -121,13 +338,79 @@ namespace lumina
         {
             if (parent)
             {
-                global_transform = parent->global_transform * getLocalTransform();
+                global_transform = parent->getGlobalTransform() * getLocalTransform();
             }
             else
             {
                 global_transform = getLocalTransform();
             }
         }
+
+        // Picks the mesh LOD from the projected size of its error: screen
+        // units per object space unit at the distance of the bounding sphere
+        size_t selectLod(const glm::mat4& view, const glm::mat4& projection) const
+        {
+            if (!mesh || mesh->getLodCount() <= 1)
+                return 0;
+
+            const glm::mat4& world = getGlobalTransform();
+            float world_scale = std::max({glm::length(glm::vec3(world[0])),
+                                          glm::length(glm::vec3(world[1])),
+                                          glm::length(glm::vec3(world[2]))});
+            // projection[1][1] spans half the viewport height
+            float screen_scale = projection[1][1] * 0.5f * world_scale;
+
+            // Perspective projections shrink with the distance, orthographic ones do not
+            if (projection[3][3] == 0.0f)
+            {
+                glm::vec4 center = view * world * glm::vec4(mesh->getBoundsCenter(), 1.0f);
+                float distance = -center.z - mesh->getBoundsRadius() * world_scale;
+                if (distance <= 0.0f)
+                    return 0;
+                screen_scale /= distance;
+            }
+
+            return mesh->selectLod(screen_scale, lod_error_threshold);
+        }
     private:
+        // Scratch storage of render(), kept to reuse it between frames
+        struct RenderList
+        {
+            std::vector<Node*> nodes;
+            BoundsBatch bounds;
+            std::vector<uint8_t> visible;
+            RenderQueue queue;
+        };
+        std::unique_ptr<RenderList> render_list;
+        CullingStats culling_stats;
+
+        void collectDrawable(std::vector<Node*>& nodes)
+        {
+            if (isDrawable())
+                nodes.push_back(this);
+            for (auto& child : childs)
+            {
+                child->collectDrawable(nodes);
+            }
+        }
+
+        void updateJob(JobSystem& jobs, JobSystem::Job* parent_job, unsigned int depth)
+        {
+            computeGlobalTransform();
+
+            for (auto& child : childs)
+            {
+                // Leaves are not worth a job
+                if (depth == 0 || child->childs.empty())
+                {
+                    child->update();
+                    continue;
+                }
+                Node* node = child.get();
+                jobs.submit([node, &jobs, depth](JobSystem::Job* job) {
+                    node->updateJob(jobs, job, depth - 1);
+                }, parent_job);
+            }
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace lumina
+{
+    // Source text per stage type, sorted by stage
+    using ShaderSources = std::vector<std::pair<GLenum, std::string>>;
+
+    // On-disk cache of linked program binaries. An entry is keyed by the
+    // sources of every stage together with the vendor, renderer and version
+    // strings of the driver, so a driver update or an edited shader misses
+    // instead of loading a stale binary. Drivers may still reject a binary,
+    // load() then returns false and the caller compiles as usual.
+    //
+    // Disabled until setDirectory() is called.
+    class ProgramCache
+    {
+    public:
+        static ProgramCache& shared()
+        {
+            static ProgramCache cache;
+            return cache;
+        }
+
+        // An empty path disables the cache
+        void setDirectory(const std::string& path)
+        {
+            directory = path;
+            if (directory.empty())
+                return;
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            if (error)
+            {
+                std::cerr << "ProgramCache: cannot create " << directory << ": " << error.message() << std::endl;
+                directory.clear();
+            }
+        }
+
+        const std::string& getDirectory() const { return directory; }
+
+        bool isEnabled() const
+        {
+            if (directory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+                return false;
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            return formats > 0;
+        }
+
+        uint64_t makeKey(const ShaderSources& sources) const
+        {
+            uint64_t hash = FNV_OFFSET;
+            for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+            {
+                const char* value = reinterpret_cast<const char*>(glGetString(name));
+                if (value)
+                    hash = hashBytes(hash, value, std::char_traits<char>::length(value));
+                hash = hashBytes(hash, "\0", 1);
+            }
+            return hashSources(sources, hash);
+        }
+
+        // FNV-1a over the stages, independent of the driver
+        static uint64_t hashSources(const ShaderSources& sources, uint64_t hash = FNV_OFFSET)
+        {
+            for (const auto& [type, source] : sources)
+            {
+                hash = hashBytes(hash, &type, sizeof(type));
+                hash = hashBytes(hash, source.data(), source.size());
+                hash = hashBytes(hash, "\0", 1);
+            }
+            return hash;
+        }
+
+        // Loads the binary into program and returns true if it linked
+        bool load(GLuint program, uint64_t key) const
+        {
+            FILE* file = fopen(pathOf(key).c_str(), "rb");
+            if (!file)
+                return false;
+
+            Header header;
+            std::vector<char> binary;
+            bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == MAGIC && header.key == key;
+            if (valid)
+            {
+                binary.resize(header.length);
+                valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+            }
+            fclose(file);
+            if (!valid)
+                return false;
+
+            glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+            GLint linked = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            return linked == GL_TRUE;
+        }
+
+        // Writes the binary of a linked program. It has to be linked with
+        // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+        void store(GLuint program, uint64_t key) const
+        {
+            GLint length = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length <= 0)
+                return;
+
+            std::vector<char> binary(length);
+            Header header;
+            header.key = key;
+            glGetProgramBinary(program, length, &length, &header.format, binary.data());
+            header.length = static_cast<uint32_t>(length);
+
+            // Written under a temporary name first, so a crash cannot leave
+            // a truncated entry behind
+            std::string path = pathOf(key);
+            std::string temporary = path + ".tmp";
+            FILE* file = fopen(temporary.c_str(), "wb");
+            if (!file)
+            {
+                std::cerr << "ProgramCache: cannot write " << temporary << std::endl;
+                return;
+            }
+            bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                           fwrite(binary.data(), 1, header.length, file) == header.length;
+            written = fclose(file) == 0 && written;
+
+            std::error_code error;
+            if (written)
+                std::filesystem::rename(temporary, path, error);
+            if (!written || error)
+                std::filesystem::remove(temporary, error);
+        }
+
+    private:
+        static constexpr uint32_t MAGIC = 0x3142504C; // "LPB1"
+        static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+        struct Header
+        {
+            uint32_t magic = MAGIC;
+            GLenum format = 0;
+            uint64_t key = 0;
+            uint32_t length = 0;
+            uint32_t reserved = 0;
+        };
+
+        std::string directory;
+
+        ProgramCache() = default;
+
+        std::string pathOf(uint64_t key) const
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+            return (std::filesystem::path(directory) / name).string();
+        }
+
+        // FNV-1a, continued from hash
+        static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+    };
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "camera.hpp"
+#include "frame_uniforms.hpp"
+#include "instancing.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+#include "shader.hpp"
+
+namespace lumina
+{
+    // Passes are drawn in this order. The queue only orders the draws, the
+    // blend and depth state of a pass is up to the application.
+    enum class RenderPass : uint8_t
+    {
+        Opaque = 0,
+        Transparent = 1,
+        Overlay = 2
+    };
+
+    // One draw call with everything needed to submit it
+    struct DrawItem
+    {
+        Shader* shader = nullptr;
+        const Material* material = nullptr;  // optional uniforms applied on top of the shader
+        Mesh* mesh = nullptr;
+        Camera* camera = nullptr;
+        const MeshletDrawList* meshlets = nullptr; // visible clusters, nullptr for a plain draw
+        uint32_t lod = 0;
+        glm::mat4 model = glm::mat4(1.0f);
+    };
+
+    // Collects draw items, sorts them by a 64 bit key and submits them with
+    // as few state changes as possible.
+    //
+    // Key layout, most significant bits first:
+    //   opaque/overlay: pass(4) shader(12) material(12) mesh(12) depth(24)
+    //   transparent:    pass(4) depth(24) shader(12) material(12) mesh(12)
+    // Opaque draws are grouped by state and go front to back inside a group,
+    // transparent ones go back to front. Shaders, materials and meshes get
+    // dense ids in the order the queue first sees them after clear(), so
+    // large GL names and material ids do not collide. Material id 0 is kept
+    // for draws without one. Past 4095 distinct states of a kind in one frame
+    // the rest share the last id.
+    class RenderQueue
+    {
+    public:
+        struct Stats
+        {
+            size_t draws = 0;
+            size_t shader_changes = 0;
+            size_t material_changes = 0;
+            size_t mesh_changes = 0;
+            size_t instanced_draws = 0;  // included in draws
+            size_t instances = 0;        // drawn by the instanced draws
+        };
+
+        void clear()
+        {
+            items.clear();
+            entries.clear();
+            shader_ids.clear();
+            material_ids.clear();
+            mesh_ids.clear();
+        }
+
+        void reserve(size_t count)
+        {
+            items.reserve(count);
+            entries.reserve(count);
+        }
+
+        // view_depth is the distance in front of the camera
+        void add(RenderPass pass, const DrawItem& item, float view_depth)
+        {
+            uint32_t material = item.material ? item.material->getId() : 0;
+            uint64_t key = makeKey(pass, shader_ids.get(item.shader->shader_id), material_ids.get(material),
+                                   mesh_ids.get(item.mesh->getVertexArray()), view_depth);
+            entries.push_back({key, static_cast<uint32_t>(items.size())});
+            items.push_back(item);
+        }
+
+        static uint64_t makeKey(RenderPass pass, uint32_t shader, uint32_t material, uint32_t mesh, float view_depth)
+        {
+            uint64_t state = (static_cast<uint64_t>(shader & 0xFFF) << 24) |
+                             (static_cast<uint64_t>(material & 0xFFF) << 12) |
+                             static_cast<uint64_t>(mesh & 0xFFF);
+            uint64_t depth = depthBits(view_depth);
+            uint64_t key = static_cast<uint64_t>(pass) << 60;
+            if (pass == RenderPass::Transparent)
+                return key | ((0xFFFFFFu - depth) << 36) | state;
+            return key | (state << 24) | depth;
+        }
+
+        // LSD radix sort over the keys, 8 bits per pass. Passes where every
+        // key has the same digit are skipped, which with few distinct states
+        // is most of them.
+        void sort()
+        {
+            scratch.resize(entries.size());
+            for (unsigned int shift = 0; shift < 64; shift += 8)
+            {
+                size_t counts[256] = {};
+                for (const SortEntry& entry : entries)
+                    counts[(entry.key >> shift) & 0xFF]++;
+                if (counts[(entries.empty() ? 0 : entries[0].key >> shift) & 0xFF] == entries.size())
+                    continue;
+
+                size_t offset = 0;
+                for (size_t& count : counts)
+                {
+                    size_t next = offset + count;
+                    count = offset;
+                    offset = next;
+                }
+                for (const SortEntry& entry : entries)
+                    scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+                entries.swap(scratch);
+            }
+        }
+
+        // Draws everything in key order. Shader, material and mesh are only
+        // rebound when they differ from the previous draw. Consecutive draws
+        // with an instanced shader (see Shader::isInstanced) that only differ
+        // in their transform become one instanced draw.
+        void submit()
+        {
+            stats = Stats();
+            batchInstances();
+
+            Shader* shader = nullptr;
+            const Material* material = nullptr;
+            Mesh* mesh = nullptr;
+            Camera* camera = nullptr;
+            Camera* frame_camera = nullptr;  // camera of the bound Frame block
+            GLint model_location = -1;
+
+            for (const Run& run : runs)
+            {
+                const DrawItem& item = items[entries[run.begin].index];
+                if (item.shader != shader)
+                {
+                    shader = item.shader;
+                    shader->bind();
+                    model_location = shader->getUniformLocation(BuiltinUniform::Model);
+                    // Uniforms belong to the program, so a new one needs them again
+                    camera = nullptr;
+                    material = nullptr;
+                    stats.shader_changes++;
+                }
+                if (item.camera != camera)
+                {
+                    camera = item.camera;
+                    if (shader->usesFrameBlock())
+                    {
+                        // Shared by all programs, survives shader changes
+                        if (camera != frame_camera)
+                        {
+                            FrameUniforms::shared().bindCamera(*camera);
+                            frame_camera = camera;
+                        }
+                    }
+                    else
+                    {
+                        glm::mat4 view = camera->getViewMatrix();
+                        glm::mat4 projection = camera->getProjectionMatrix();
+                        glUniformMatrix4fv(shader->getUniformLocation(BuiltinUniform::View), 1, GL_FALSE, glm::value_ptr(view));
+                        glUniformMatrix4fv(shader->getUniformLocation(BuiltinUniform::Projection), 1, GL_FALSE, glm::value_ptr(projection));
+                    }
+                }
+                if (item.material != material)
+                {
+                    material = item.material;
+                    if (material)
+                        material->apply(*shader);
+                    stats.material_changes++;
+                }
+                if (item.mesh != mesh)
+                {
+                    mesh = item.mesh;
+                    mesh->bind();
+                    stats.mesh_changes++;
+                }
+
+                if (run.first_instance != NO_INSTANCES)
+                {
+                    uint32_t count = static_cast<uint32_t>(run.end - run.begin);
+                    instances.draw(*mesh, item.lod, run.first_instance, count);
+                    stats.instanced_draws++;
+                    stats.instances += count;
+                }
+                else
+                {
+                    glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(item.model));
+                    if (item.meshlets)
+                        mesh->drawMeshlets(*item.meshlets);
+                    else
+                        mesh->drawElements(item.lod);
+                }
+                stats.draws++;
+            }
+
+            if (mesh)
+                mesh->unbind();
+            if (shader)
+                shader->unbind();
+            if (instances.size() > 0)
+                instances.fence();
+            if (frame_camera)
+                FrameUniforms::shared().fence();
+        }
+
+        size_t size() const { return items.size(); }
+        const Stats& getStats() const { return stats; }
+
+    private:
+        struct SortEntry
+        {
+            uint64_t key;
+            uint32_t index;
+        };
+
+        // Sorted entries [begin, end) drawn with one call
+        struct Run
+        {
+            size_t begin;
+            size_t end;
+            uint32_t first_instance;
+        };
+        static constexpr uint32_t NO_INSTANCES = ~0u;
+
+        // Raw id to the 12 bit id used in the keys
+        struct DenseIds
+        {
+            // Keeps dense id 0 for raw id 0
+            bool reserve_zero = false;
+            std::unordered_map<uint32_t, uint32_t> ids;
+
+            uint32_t get(uint32_t raw)
+            {
+                if (reserve_zero && raw == 0)
+                    return 0;
+                uint32_t next = static_cast<uint32_t>(ids.size()) + (reserve_zero ? 1 : 0);
+                auto it = ids.try_emplace(raw, next).first;
+                return std::min<uint32_t>(it->second, 0xFFF);
+            }
+
+            void clear() { ids.clear(); }
+        };
+
+        DenseIds shader_ids;
+        // Draws without a material go first in their shader group, so they
+        // never inherit the uniforms of a material drawn before them
+        DenseIds material_ids{true};
+        DenseIds mesh_ids;
+        std::vector<DrawItem> items;
+        std::vector<SortEntry> entries;
+        std::vector<Run> runs;
+        InstanceBatcher instances;
+        std::vector<SortEntry> scratch;
+        Stats stats;
+
+        static bool sameBatch(const DrawItem& a, const DrawItem& b)
+        {
+            return a.shader == b.shader && a.material == b.material && a.mesh == b.mesh &&
+                   a.camera == b.camera && a.lod == b.lod && !b.meshlets;
+        }
+
+        // Splits the sorted entries into draw calls and uploads the
+        // transforms of the instanced ones in one go
+        void batchInstances()
+        {
+            runs.clear();
+            instances.clear();
+            for (size_t begin = 0; begin < entries.size();)
+            {
+                const DrawItem& item = items[entries[begin].index];
+                size_t end = begin + 1;
+                if (!item.shader->isInstanced() || item.meshlets)
+                {
+                    runs.push_back({begin, end, NO_INSTANCES});
+                    begin = end;
+                    continue;
+                }
+
+                while (end < entries.size() && sameBatch(item, items[entries[end].index]))
+                    end++;
+                uint32_t first = static_cast<uint32_t>(instances.size());
+                for (size_t i = begin; i < end; i++)
+                {
+                    instances.add(items[entries[i].index].model);
+                }
+                runs.push_back({begin, end, first});
+                begin = end;
+            }
+
+            if (instances.size() > 0)
+                instances.upload();
+        }
+
+        // Positive floats compare like their bit patterns, the top 24 bits
+        // keep the order at reduced precision
+        static uint64_t depthBits(float depth)
+        {
+            if (!(depth > 0.0f))
+                return 0;
+            uint32_t bits;
+            std::memcpy(&bits, &depth, sizeof(bits));
+            return bits >> 8;
+        }
+    };
+}
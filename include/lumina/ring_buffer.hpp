@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gl_state.hpp"
+
+namespace lumina
+{
+    // Streaming buffer for data that is written once per draw or frame.
+    //
+    // The storage is split into SEGMENT_COUNT segments that are filled one
+    // after another. Every segment is guarded by a fence placed after the
+    // commands that read it (see fence()); a segment is only written again
+    // once its fence signaled, so the CPU can run up to two segments ahead
+    // of the GPU without implicit driver syncs.
+    //
+    // With ARB_buffer_storage the buffer is mapped once, persistent and
+    // coherent, and allocations point straight into it. Without it writes
+    // go to a CPU copy that flush() uploads, and the buffer is orphaned
+    // whenever the ring wraps around.
+    class RingBuffer
+    {
+    public:
+        static constexpr unsigned int SEGMENT_COUNT = 3;
+
+        struct Allocation
+        {
+            void* data = nullptr;   // write the data here, then call flush()
+            size_t offset = 0;      // in bytes, from the start of getBuffer()
+        };
+
+        RingBuffer(GLenum target, size_t segment_size)
+        : target(target)
+        {
+            create(std::max<size_t>(segment_size, 256));
+        }
+
+        ~RingBuffer()
+        {
+            destroy();
+        }
+
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        // Reserves size bytes at the given alignment. Moves on to the next
+        // segment when the current one is full, waiting for the GPU if it
+        // still reads that segment; grows the buffer when a single
+        // allocation does not fit into a segment.
+        Allocation allocate(size_t size, size_t alignment = 16)
+        {
+            size_t offset = alignUp(head, alignment);
+            if (offset + size > segmentEnd(segment))
+            {
+                if (size > segment_size)
+                {
+                    destroy();
+                    create(alignUp(std::max(size, segment_size * 2), 256));
+                }
+                else
+                {
+                    nextSegment();
+                }
+                offset = alignUp(head, alignment);
+            }
+
+            head = offset + size;
+            Allocation allocation;
+            allocation.offset = offset;
+            allocation.data = (mapped ? mapped : staging.data()) + offset;
+            return allocation;
+        }
+
+        // Makes everything written since the last flush visible to the GPU.
+        // A no-op for coherent persistent mappings.
+        void flush()
+        {
+            if (mapped || head <= flushed)
+            {
+                flushed = head;
+                return;
+            }
+            GLState::shared().bindBuffer(target, buffer);
+            glBufferSubData(target, flushed, head - flushed, staging.data() + flushed);
+            flushed = head;
+        }
+
+        // Call after issuing the commands that read the latest allocations
+        void fence()
+        {
+            if (fences[segment])
+                glDeleteSync(fences[segment]);
+            fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        GLuint getBuffer() const { return buffer; }
+        GLenum getTarget() const { return target; }
+        size_t getSegmentSize() const { return segment_size; }
+        bool isPersistent() const { return mapped != nullptr; }
+
+        // Offset alignment required for glBindBufferRange on uniform buffers
+        static size_t uniformAlignment()
+        {
+            GLint alignment = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            return alignment > 0 ? static_cast<size_t>(alignment) : 256;
+        }
+
+    private:
+        GLenum target;
+        GLuint buffer = 0;
+        size_t segment_size = 0;
+        unsigned int segment = 0;
+        size_t head = 0;
+        size_t flushed = 0;
+        uint8_t* mapped = nullptr;
+        std::vector<uint8_t> staging;
+        GLsync fences[SEGMENT_COUNT] = {};
+
+        static size_t alignUp(size_t value, size_t alignment)
+        {
+            return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+        }
+
+        size_t segmentEnd(unsigned int index) const { return (index + 1) * segment_size; }
+
+        void create(size_t new_segment_size)
+        {
+            segment_size = new_segment_size;
+            const size_t total = segment_size * SEGMENT_COUNT;
+
+            glGenBuffers(1, &buffer);
+            GLState::shared().bindBuffer(target, buffer);
+            if (GLEW_ARB_buffer_storage)
+            {
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(target, total, nullptr, flags);
+                mapped = static_cast<uint8_t*>(glMapBufferRange(target, 0, total, flags));
+                if (!mapped)
+                    std::cerr << "RingBuffer: persistent mapping failed, falling back to orphaning" << std::endl;
+            }
+            if (!mapped)
+            {
+                // Immutable storage cannot be orphaned, start over with a mutable buffer
+                if (GLEW_ARB_buffer_storage)
+                {
+                    GLState::shared().forgetBuffer(buffer);
+                    glDeleteBuffers(1, &buffer);
+                    glGenBuffers(1, &buffer);
+                    GLState::shared().bindBuffer(target, buffer);
+                }
+                glBufferData(target, total, nullptr, GL_STREAM_DRAW);
+                staging.resize(total);
+            }
+            GLState::shared().bindBuffer(target, 0);
+
+            segment = 0;
+            head = 0;
+            flushed = 0;
+        }
+
+        void destroy()
+        {
+            for (GLsync& sync : fences)
+            {
+                if (sync)
+                {
+                    waitFor(sync);
+                    glDeleteSync(sync);
+                    sync = nullptr;
+                }
+            }
+            if (buffer)
+            {
+                if (mapped)
+                {
+                    GLState::shared().bindBuffer(target, buffer);
+                    glUnmapBuffer(target);
+                    GLState::shared().bindBuffer(target, 0);
+                }
+                GLState::shared().forgetBuffer(buffer);
+                glDeleteBuffers(1, &buffer);
+            }
+            buffer = 0;
+            mapped = nullptr;
+            staging.clear();
+        }
+
+        void nextSegment()
+        {
+            flush();
+            // Covers the commands issued for the segment that is left, in
+            // case the caller did not fence it
+            fence();
+
+            segment = (segment + 1) % SEGMENT_COUNT;
+            head = segment * segment_size;
+            flushed = head;
+
+            if (fences[segment])
+            {
+                waitFor(fences[segment]);
+                glDeleteSync(fences[segment]);
+                fences[segment] = nullptr;
+            }
+
+            if (!mapped && segment == 0)
+            {
+                GLState::shared().bindBuffer(target, buffer);
+                glBufferData(target, segment_size * SEGMENT_COUNT, nullptr, GL_STREAM_DRAW);
+                GLState::shared().bindBuffer(target, 0);
+            }
+        }
+
+        static void waitFor(GLsync sync)
+        {
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            while (true)
+            {
+                GLenum result = glClientWaitSync(sync, flags, 1000000000);
+                if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+                    return;
+                flags = 0;
+            }
+        }
+    };
+}
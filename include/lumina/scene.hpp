@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../libs/glm/glm.hpp"
+
+#include "node.hpp"
+#include "job_system.hpp"
+
+namespace lumina
+{
+    // Flattened storage of a node hierarchy for large scenes.
+    //
+    // The nodes are stored in depth first order, so every parent comes
+    // before its children and a subtree is the contiguous range
+    // [i, subtree_ends[i]). Positions, rotations, scales, parent links and
+    // local/world matrices live in parallel arrays; the Node objects are
+    // not touched during update(). Node setters write through to the arrays
+    // and record the change, so update() only recomputes the local matrix
+    // of changed nodes and the world matrices of their subtrees, in a
+    // single forward pass. Node::getGlobalTransform() reads the result.
+    class Scene
+    {
+    public:
+        explicit Scene(std::shared_ptr<Node> root)
+        : root(std::move(root))
+        {
+            rebuild();
+        }
+
+        ~Scene()
+        {
+            detach();
+        }
+
+        Scene(const Scene&) = delete;
+        Scene& operator=(const Scene&) = delete;
+
+        // Flattens the hierarchy again. Called by update() after nodes were
+        // added or removed.
+        void rebuild()
+        {
+            detach();
+            storage.structure_changed = false;
+            version++;
+
+            std::vector<std::pair<std::shared_ptr<Node>, int32_t>> stack;
+            if (root)
+                stack.push_back({root, -1});
+
+            while (!stack.empty())
+            {
+                auto [node, parent] = stack.back();
+                stack.pop_back();
+
+                uint32_t index = static_cast<uint32_t>(nodes.size());
+                nodes.push_back(node);
+                parents.push_back(parent);
+                storage.positions.push_back(node->position);
+                storage.rotations.push_back(node->rotation);
+                storage.scales.push_back(node->scale);
+
+                // Reversed, so children come out of the stack in list order
+                for (auto it = node->childs.rbegin(); it != node->childs.rend(); ++it)
+                {
+                    stack.push_back({*it, static_cast<int32_t>(index)});
+                }
+            }
+
+            // Walking backwards every child is done before its parent
+            const uint32_t count = static_cast<uint32_t>(nodes.size());
+            subtree_ends.resize(count);
+            for (uint32_t i = 0; i < count; i++)
+                subtree_ends[i] = i + 1;
+            for (uint32_t i = count; i-- > 0;)
+            {
+                if (parents[i] >= 0)
+                    subtree_ends[parents[i]] = std::max(subtree_ends[parents[i]], subtree_ends[i]);
+            }
+
+            local_transforms.assign(count, glm::mat4(1.0f));
+            storage.world_transforms.assign(count, glm::mat4(1.0f));
+
+            // Everything starts dirty
+            storage.dirty.resize(count);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                storage.dirty[i] = i;
+                nodes[i]->scene_storage = &storage;
+                nodes[i]->scene_index = i;
+                nodes[i]->transform_dirty = true;
+            }
+        }
+
+        // Recomputes the transforms of changed nodes and their subtrees
+        void update()
+        {
+            if (!prepareUpdate())
+                return;
+
+            computeLocalTransforms(0, storage.dirty.size());
+
+            uint32_t covered = 0;
+            for (uint32_t index : storage.dirty)
+            {
+                uint32_t end = subtree_ends[index];
+                if (index >= covered)
+                {
+                    computeWorldTransforms(index, end);
+                    updated_ranges.push_back({index, end});
+                    last_updated += end - index;
+                    covered = end;
+                }
+            }
+
+            finishUpdate();
+        }
+
+        // Same as update(), with large subtrees spread over the job system.
+        // Sibling subtrees only read their common parent, so they are
+        // independent of each other.
+        void update(JobSystem& jobs)
+        {
+            if (!prepareUpdate())
+                return;
+
+            jobs.parallelFor(storage.dirty.size(), PARALLEL_GRAIN, [this](size_t begin, size_t end) {
+                computeLocalTransforms(begin, end);
+            });
+
+            JobSystem::Job* group = jobs.createJob(nullptr);
+            uint32_t covered = 0;
+            for (uint32_t index : storage.dirty)
+            {
+                uint32_t end = subtree_ends[index];
+                if (index >= covered)
+                {
+                    updateSubtree(jobs, group, index, end);
+                    updated_ranges.push_back({index, end});
+                    last_updated += end - index;
+                    covered = end;
+                }
+            }
+            jobs.wait(jobs.run(group));
+
+            finishUpdate();
+        }
+
+        // Draws the nodes inside the camera frustum in hierarchy order
+        void render()
+        {
+            drawable.clear();
+            for (const std::shared_ptr<Node>& node : nodes)
+            {
+                if (node->isDrawable())
+                    drawable.push_back(node.get());
+            }
+            culling_stats = Node::renderCulled(drawable, drawable_bounds, drawable_visible, queue);
+        }
+
+        size_t size() const { return nodes.size(); }
+        const std::vector<std::shared_ptr<Node>>& getNodes() const { return nodes; }
+        const std::vector<int32_t>& getParents() const { return parents; }
+        const std::vector<glm::mat4>& getWorldTransforms() const { return storage.world_transforms; }
+        std::shared_ptr<Node> getRoot() const { return root; }
+
+        // Number of world transforms recomputed by the last update()
+        size_t getLastUpdatedCount() const { return last_updated; }
+
+        // Node ranges [first, second) whose world transforms the last
+        // update() recomputed, in ascending order
+        const std::vector<std::pair<uint32_t, uint32_t>>& getUpdatedRanges() const { return updated_ranges; }
+
+        // Changes whenever the hierarchy was flattened again and node
+        // indices moved
+        uint64_t getVersion() const { return version; }
+        // Number of update() calls so far
+        uint64_t getUpdateCount() const { return update_count; }
+
+        // Visible and culled meshes of the last render()
+        const CullingStats& getCullingStats() const { return culling_stats; }
+        // Draw calls and state changes of the last render()
+        const RenderQueue::Stats& getRenderStats() const { return queue.getStats(); }
+
+    private:
+        std::shared_ptr<Node> root;
+        SceneStorage storage;
+
+        std::vector<std::shared_ptr<Node>> nodes;
+        std::vector<int32_t> parents;          // -1 for the root
+        std::vector<uint32_t> subtree_ends;    // one past the last descendant
+        std::vector<glm::mat4> local_transforms;
+        std::vector<uint8_t> dirty_flags;
+        glm::mat4 base_transform = glm::mat4(1.0f);
+
+        size_t last_updated = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> updated_ranges;
+        uint64_t version = 0;
+        uint64_t update_count = 0;
+
+        // Scratch storage of render()
+        std::vector<Node*> drawable;
+        BoundsBatch drawable_bounds;
+        std::vector<uint8_t> drawable_visible;
+        RenderQueue queue;
+        CullingStats culling_stats;
+
+        // Subtrees smaller than this are updated by a single job
+        static constexpr uint32_t PARALLEL_GRAIN = 2048;
+
+        // Rebuilds if needed and sorts the dirty list. Returns false when
+        // there is nothing to do.
+        bool prepareUpdate()
+        {
+            if (storage.structure_changed)
+                rebuild();
+
+            update_count++;
+            last_updated = 0;
+            updated_ranges.clear();
+            std::vector<uint32_t>& dirty = storage.dirty;
+            if (dirty.empty())
+                return false;
+
+            // Few changes are sorted, many are bucketed through a flag sweep
+            if (dirty.size() * 16 < nodes.size())
+            {
+                std::sort(dirty.begin(), dirty.end());
+                dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+            }
+            else
+            {
+                dirty_flags.assign(nodes.size(), 0);
+                for (uint32_t index : dirty)
+                    dirty_flags[index] = 1;
+                dirty.clear();
+                for (uint32_t i = 0; i < dirty_flags.size(); i++)
+                {
+                    if (dirty_flags[i])
+                        dirty.push_back(i);
+                }
+            }
+
+            // The root may hang below a node outside of this scene
+            base_transform = root && root->parent ? root->parent->getGlobalTransform() : glm::mat4(1.0f);
+            return true;
+        }
+
+        void finishUpdate()
+        {
+            // Setters only record a node once until it was processed
+            for (uint32_t index : storage.dirty)
+            {
+                nodes[index]->transform_dirty = false;
+            }
+            storage.dirty.clear();
+        }
+
+        // Local matrices of dirty[begin, end). All of them are computed before
+        // the world pass, a subtree range may cover a later dirty node.
+        void computeLocalTransforms(size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                uint32_t index = storage.dirty[i];
+                local_transforms[index] = Node::composeTransform(storage.positions[index], storage.rotations[index],
+                                                                 storage.scales[index]);
+            }
+        }
+
+        // World matrices of the nodes [begin, end). Parents outside of the
+        // range must be up to date already.
+        void computeWorldTransforms(uint32_t begin, uint32_t end)
+        {
+            std::vector<glm::mat4>& world_transforms = storage.world_transforms;
+            for (uint32_t i = begin; i < end; i++)
+            {
+                int32_t parent = parents[i];
+                world_transforms[i] = (parent >= 0 ? world_transforms[parent] : base_transform) * local_transforms[i];
+            }
+        }
+
+        void updateSubtree(JobSystem& jobs, JobSystem::Job* parent_job, uint32_t begin, uint32_t end)
+        {
+            if (end - begin <= PARALLEL_GRAIN)
+            {
+                jobs.submit([this, begin, end](JobSystem::Job*) { computeWorldTransforms(begin, end); }, parent_job);
+                return;
+            }
+
+            computeWorldTransforms(begin, begin + 1);
+
+            // Runs of small sibling subtrees are batched into one job, large
+            // ones are split further
+            uint32_t batch_begin = begin + 1;
+            uint32_t child = begin + 1;
+            while (child < end)
+            {
+                uint32_t child_end = subtree_ends[child];
+                if (child_end - child > PARALLEL_GRAIN)
+                {
+                    if (batch_begin < child)
+                        updateSubtree(jobs, parent_job, batch_begin, child);
+                    jobs.submit([this, &jobs, child, child_end](JobSystem::Job* job) {
+                        updateSubtree(jobs, job, child, child_end);
+                    }, parent_job);
+                    batch_begin = child_end;
+                }
+                else if (child_end - batch_begin > PARALLEL_GRAIN && batch_begin < child)
+                {
+                    updateSubtree(jobs, parent_job, batch_begin, child);
+                    batch_begin = child;
+                }
+                child = child_end;
+            }
+            if (batch_begin < end)
+                updateSubtree(jobs, parent_job, batch_begin, end);
+        }
+
+        // Hands the nodes back to standalone mode with their current world transform
+        void detach()
+        {
+            for (const std::shared_ptr<Node>& node : nodes)
+            {
+                if (node->scene_storage == &storage)
+                {
+                    node->global_transform = storage.world_transforms[node->scene_index];
+                    node->scene_storage = nullptr;
+                }
+            }
+            nodes.clear();
+            parents.clear();
+            subtree_ends.clear();
+            storage.positions.clear();
+            storage.rotations.clear();
+            storage.scales.clear();
+            storage.world_transforms.clear();
+            storage.dirty.clear();
+        }
+    };
+}
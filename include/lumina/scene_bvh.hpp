@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+#include "scene.hpp"
+
+namespace lumina
+{
+    struct RayHit
+    {
+        Node* node = nullptr;
+        float distance = std::numeric_limits<float>::infinity(); // in units of the ray direction
+        unsigned int triangle = 0;                               // into Mesh::getIndices(), in triangles
+        glm::vec3 position = glm::vec3(0.0f);                    // world space
+        glm::vec2 barycentric = glm::vec2(0.0f);                 // of the second and third vertex
+    };
+
+    // BVH over the world bounds of the meshes of a Scene, for picking and
+    // region queries. update() refits the nodes the last Scene::update()
+    // moved and rebuilds when the hierarchy changed or the refitted tree got
+    // too loose.
+    class SceneBvh
+    {
+    public:
+        // Rebuild once refits made the tree this much more expensive than
+        // right after the last build
+        float rebuild_threshold = 1.5f;
+
+        explicit SceneBvh(const Scene& scene)
+        : scene(scene)
+        {
+            rebuild();
+        }
+
+        // Call after every Scene::update()
+        void update()
+        {
+            // Missed updates leave no trace of what moved
+            if (scene.getVersion() != version || scene.getUpdateCount() != update_count + 1)
+            {
+                rebuild();
+                return;
+            }
+            update_count = scene.getUpdateCount();
+
+            for (const auto& range : scene.getUpdatedRanges())
+            {
+                for (uint32_t i = range.first; i < range.second; i++)
+                {
+                    if (!bvh.contains(i))
+                        continue;
+                    bvh.refit(i, worldBounds(i));
+                }
+            }
+
+            if (bvh.getCost() > bvh.getBuildCost() * rebuild_threshold)
+                rebuild();
+        }
+
+        void rebuild()
+        {
+            version = scene.getVersion();
+            update_count = scene.getUpdateCount();
+
+            std::vector<Bounds> bounds(scene.size());
+            for (uint32_t i = 0; i < bounds.size(); i++)
+            {
+                bounds[i] = worldBounds(i);
+            }
+            bvh.build(bounds);
+        }
+
+        // Nodes whose world box intersects the frustum
+        void queryFrustum(const Frustum& frustum, std::vector<Node*>& result) const
+        {
+            query_items.clear();
+            bvh.queryFrustum(frustum, query_items);
+            appendNodes(result);
+        }
+
+        // Nodes whose world box overlaps [min, max]
+        void queryBox(const glm::vec3& min, const glm::vec3& max, std::vector<Node*>& result) const
+        {
+            query_items.clear();
+            bvh.queryBox(min, max, query_items);
+            appendNodes(result);
+        }
+
+        // Nearest triangle hit along origin + t * direction for t in
+        // [0, max_distance]. Meshes without CPU side data cannot be hit.
+        bool raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit,
+                     float max_distance = std::numeric_limits<float>::infinity()) const
+        {
+            RayHit best;
+            bvh.raycast(origin, direction, max_distance, [&](uint32_t item, float range) {
+                RayHit candidate;
+                if (intersectMesh(item, origin, direction, range, candidate) && candidate.distance < best.distance)
+                    best = candidate;
+                return candidate.distance;
+            });
+
+            if (!best.node)
+                return false;
+            best.position = origin + direction * best.distance;
+            hit = best;
+            return true;
+        }
+
+        const Bvh& getBvh() const { return bvh; }
+
+    private:
+        const Scene& scene;
+        Bvh bvh;
+        uint64_t version = 0;
+        uint64_t update_count = 0;
+        mutable std::vector<uint32_t> query_items;
+
+        Bounds worldBounds(uint32_t index) const
+        {
+            const std::shared_ptr<Mesh>& mesh = scene.getNodes()[index]->mesh;
+            return mesh ? mesh->getBounds().transformed(scene.getWorldTransforms()[index]) : Bounds();
+        }
+
+        void appendNodes(std::vector<Node*>& result) const
+        {
+            for (uint32_t item : query_items)
+            {
+                result.push_back(scene.getNodes()[item].get());
+            }
+        }
+
+        // Tests the ray against the triangles of one mesh in its object
+        // space. The ray parameter is the same in both spaces.
+        bool intersectMesh(uint32_t index, const glm::vec3& origin, const glm::vec3& direction,
+                           float max_distance, RayHit& hit) const
+        {
+            Node* node = scene.getNodes()[index].get();
+            const Mesh& mesh = *node->mesh;
+            std::shared_ptr<std::vector<float>> positions = mesh.getPositions();
+            std::shared_ptr<std::vector<unsigned int>> indices = mesh.getIndices();
+            if (!positions || !indices)
+                return false;
+
+            glm::mat4 inverse = glm::inverse(scene.getWorldTransforms()[index]);
+            glm::vec3 local_origin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+            glm::vec3 local_direction = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+
+            const std::vector<float>& p = *positions;
+            const std::vector<unsigned int>& idx = *indices;
+            auto vertex = [&](unsigned int v) { return glm::vec3(p[v * 3], p[v * 3 + 1], p[v * 3 + 2]); };
+
+            hit.distance = max_distance;
+            bool found = false;
+            auto testTriangles = [&](size_t begin, size_t end) {
+                for (size_t i = begin; i + 2 < end; i += 3)
+                {
+                    // Moller-Trumbore
+                    glm::vec3 v0 = vertex(idx[i]);
+                    glm::vec3 edge1 = vertex(idx[i + 1]) - v0;
+                    glm::vec3 edge2 = vertex(idx[i + 2]) - v0;
+                    glm::vec3 pvec = glm::cross(local_direction, edge2);
+                    float determinant = glm::dot(edge1, pvec);
+                    if (std::abs(determinant) < std::numeric_limits<float>::epsilon())
+                        continue;
+                    float inverse_determinant = 1.0f / determinant;
+                    glm::vec3 tvec = local_origin - v0;
+                    float u = glm::dot(tvec, pvec) * inverse_determinant;
+                    if (u < 0.0f || u > 1.0f)
+                        continue;
+                    glm::vec3 qvec = glm::cross(tvec, edge1);
+                    float v = glm::dot(local_direction, qvec) * inverse_determinant;
+                    if (v < 0.0f || u + v > 1.0f)
+                        continue;
+                    float t = glm::dot(edge2, qvec) * inverse_determinant;
+                    if (t < 0.0f || t >= hit.distance)
+                        continue;
+
+                    hit.node = node;
+                    hit.distance = t;
+                    hit.triangle = static_cast<unsigned int>(i / 3);
+                    hit.barycentric = glm::vec2(u, v);
+                    found = true;
+                }
+            };
+
+            if (!mesh.hasMeshlets())
+            {
+                testTriangles(0, idx.size());
+                return found;
+            }
+
+            // Skip the clusters whose bounding sphere the ray misses
+            float direction_length2 = glm::dot(local_direction, local_direction);
+            for (const Meshlet& meshlet : mesh.getMeshlets())
+            {
+                glm::vec3 to_center = meshlet.center - local_origin;
+                float t = std::max(0.0f, glm::dot(to_center, local_direction) / direction_length2);
+                glm::vec3 offset = to_center - local_direction * t;
+                if (glm::dot(offset, offset) > meshlet.radius * meshlet.radius)
+                    continue;
+                testTriangles(meshlet.index_offset, meshlet.index_offset + meshlet.triangle_count * 3);
+            }
+            return found;
+        }
+    };
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -9,74 +12,327 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "gl_state.hpp"
+#include "program_cache.hpp"
+
 namespace lumina {
 
+// 64 bit FNV-1a of a uniform name. Never 0, which marks empty table slots.
+constexpr uint64_t hashUniformName(const char* name, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash ? hash : 1;
+}
+
+// A uniform name with its hash, computed at compile time by "name"_u.
+// The name must outlive the id, which string literals do.
+struct UniformId {
+    uint64_t hash;
+    const char* name;
+
+    constexpr UniformId(const char* name, size_t length)
+    : hash(hashUniformName(name, length)), name(name) {}
+};
+
+inline namespace literals {
+constexpr UniformId operator""_u(const char* name, size_t length) {
+    return UniformId(name, length);
+}
+}
+
+// Uniforms of the engine's own shaders, looked up once per program
+enum class BuiltinUniform : uint8_t {
+    Model,
+    View,
+    Projection,
+    Color,
+    Transform,
+    UColor,
+    UTexture,
+    UModelViewProj,
+    Count
+};
+
+// How a Shader is built. Async returns right after submitting the work to
+// the driver, see Shader::isReady().
+enum class ShaderBuild : uint8_t {
+    Blocking,
+    Async
+};
+
+enum class ShaderState : uint8_t {
+    Compiling,
+    Ready,
+    Failed
+};
+
 class Shader {
 public:
+    // Binding points of the uniform blocks shared by all programs
+    static constexpr GLuint FRAME_BINDING = 0;
+    static constexpr GLuint MATERIAL_BINDING = 1;
+
+    // A member of the Material block, offset in bytes from its start
+    struct BlockMember {
+        GLint offset;
+        GLenum type;
+    };
+
     GLuint shader_id;
 
-    Shader(const std::unordered_map<std::string, std::string>& shader_paths) {
+    Shader(const std::unordered_map<std::string, std::string>& shader_paths, ShaderBuild build_mode = ShaderBuild::Blocking)
+    : source_paths(shader_paths) {
         shader_id = glCreateProgram();
+        build(readSources(), build_mode);
+    }
 
-        std::unordered_map<std::string, GLenum> shader_types = {
-            {"vertex", GL_VERTEX_SHADER},
-            {"fragment", GL_FRAGMENT_SHADER},
-            {"geometry", GL_GEOMETRY_SHADER},
-            {"compute", GL_COMPUTE_SHADER}
-        };
+    // From source text that is already preprocessed, see ShaderVariants
+    Shader(ShaderSources sources, ShaderBuild build_mode = ShaderBuild::Blocking) {
+        shader_id = glCreateProgram();
+        std::sort(sources.begin(), sources.end());
+        build(sources, build_mode);
+    }
 
-        std::vector<GLuint> compiled_shaders;
+    virtual ~Shader() {
+        GLState::shared().forgetProgram(shader_id);
+        glDeleteProgram(shader_id);
+    }
 
-        for (const auto& [type, path] : shader_paths) {
-            if (shader_types.count(type)) {
-                GLuint shader = compile(parse(path.c_str()), shader_types[type]);
-                if (shader != 0) {
-                    glAttachShader(shader_id, shader);
-                    compiled_shaders.push_back(shader);
-                }
-            }
-        }
+    // Builds the program again from the source files and swaps it in when
+    // it links. On errors the old program stays, so a typo while editing
+    // does not break the running program. Only for shaders built from paths.
+    bool reload() {
+        if (source_paths.empty())
+            return false;
+        return reload(readSources());
+    }
 
-        glLinkProgram(shader_id);
-        checkLinkErrors(shader_id);
+    // Same from preprocessed sources
+    bool reload(ShaderSources sources) {
+        wait();
+        Shader fresh(std::move(sources), ShaderBuild::Blocking);
+        if (fresh.state != ShaderState::Ready)
+            return false;
+        swapProgram(fresh);
+        revision++;
+        return true;
+    }
 
-        // Cache uniforms once after linking
-        cacheUniformLocations();
+    // Counts successful reloads. Locations and block offsets looked up
+    // before a reload may be stale.
+    uint32_t getRevision() const {
+        return revision;
+    }
 
-        for (GLuint shader : compiled_shaders) {
-            glDeleteShader(shader);
-        }
+    // Stage name to path, empty for shaders built from sources
+    const std::unordered_map<std::string, std::string>& getSourcePaths() const {
+        return source_paths;
     }
 
-    virtual ~Shader() {
-        glDeleteProgram(shader_id);
+    // Polls an async build and finishes it once the driver is done. Without
+    // parallel compile support the first call waits for the driver.
+    bool isReady() {
+        if (state == ShaderState::Compiling && (!hasParallelCompile() || completionStatus()))
+            finish(checkBuild());
+        return state == ShaderState::Ready;
+    }
+
+    // Blocks until the build is done
+    void wait() {
+        if (state == ShaderState::Compiling)
+            finish(checkBuild());
+    }
+
+    // State as of the last isReady() or wait()
+    ShaderState getState() const {
+        return state;
+    }
+
+    // Drawn instead of shaders that are not ready yet, see resolve().
+    // Should be built with ShaderBuild::Blocking.
+    static void setPlaceholder(std::shared_ptr<Shader> shader) {
+        placeholder() = std::move(shader);
+    }
+
+    // The shader itself when ready, otherwise the placeholder, or nullptr
+    // when there is none and the draw has to be skipped
+    static Shader* resolve(Shader* shader) {
+        if (!shader || shader->isReady())
+            return shader;
+        return placeholder().get();
     }
 
     void bind() const {
-        glUseProgram(shader_id);
+        GLState::shared().useProgram(shader_id);
     }
 
     void unbind() const {
-        glUseProgram(0);
+        GLState::shared().useProgram(0);
+    }
+
+    // True when the vertex shader takes its model matrix from the per
+    // instance attribute i_model instead of the model uniform
+    bool isInstanced() const {
+        return instanced;
+    }
+
+    // True when the program declares the Frame block (see FrameUniforms)
+    // and takes view and projection from there
+    bool usesFrameBlock() const {
+        return frame_block;
+    }
+
+    // Layout of the Material block, queried once at link time. The size is
+    // 0 when the program does not declare the block.
+    GLint getMaterialBlockSize() const {
+        return material_block_size;
+    }
+
+    const std::unordered_map<std::string, BlockMember>& getMaterialMembers() const {
+        return material_members;
+    }
+
+    const BlockMember* findMaterialMember(const std::string& name) const {
+        auto it = material_members.find(name);
+        return it != material_members.end() ? &it->second : nullptr;
     }
 
     GLint getUniformLocation(const std::string& name) {
-        auto it = uniform_locations.find(name);
-        if (it != uniform_locations.end())
-            return it->second;
+        return getUniformLocation(UniformId(name.c_str(), name.size()));
+    }
+
+    // Probes the location table by the precomputed hash and only asks GL
+    // for names the program did not report at link time
+    GLint getUniformLocation(UniformId id) {
+        size_t mask = uniform_table.size() - 1;
+        for (size_t i = id.hash & mask;; i = (i + 1) & mask) {
+            const UniformSlot& slot = uniform_table[i];
+            if (slot.hash == id.hash)
+                return slot.location;
+            if (slot.hash == 0)
+                break;
+        }
 
-        GLint loc = glGetUniformLocation(shader_id, name.c_str());
-        uniform_locations[name] = loc;
-        return loc;
+        GLint location = glGetUniformLocation(shader_id, id.name);
+        insertUniform(id.hash, location);
+        return location;
+    }
+
+    GLint getUniformLocation(BuiltinUniform uniform) const {
+        return builtin_locations[static_cast<size_t>(uniform)];
     }
 
     template<typename T>
     void setUniform(const std::string& name, const T& value) {
-        static_assert(sizeof(T) == 0, "Unsupported uniform type");
+        setUniformAt(getUniformLocation(name), value);
+    }
+
+    template<typename T>
+    void setUniform(UniformId id, const T& value) {
+        setUniformAt(getUniformLocation(id), value);
+    }
+
+    template<typename T>
+    void setUniform(BuiltinUniform uniform, const T& value) {
+        setUniformAt(getUniformLocation(uniform), value);
+    }
+
+    // Set a uniform of the bound program
+    static void setUniformAt(GLint location, int value) {
+        glUniform1i(location, value);
+    }
+
+    static void setUniformAt(GLint location, float value) {
+        glUniform1f(location, value);
+    }
+
+    static void setUniformAt(GLint location, const glm::vec2& value) {
+        glUniform2fv(location, 1, glm::value_ptr(value));
+    }
+
+    static void setUniformAt(GLint location, const glm::vec3& value) {
+        glUniform3fv(location, 1, glm::value_ptr(value));
+    }
+
+    static void setUniformAt(GLint location, const glm::vec4& value) {
+        glUniform4fv(location, 1, glm::value_ptr(value));
+    }
+
+    static void setUniformAt(GLint location, const glm::mat4& value) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
     }
 
 private:
-    std::unordered_map<std::string, GLint> uniform_locations;
+    std::unordered_map<std::string, std::string> source_paths;
+    uint32_t revision = 0;
+    ShaderState state = ShaderState::Compiling;
+    std::vector<GLuint> pending_shaders;
+    bool use_cache = false;
+    uint64_t cache_key = 0;
+
+    struct UniformSlot {
+        uint64_t hash;
+        GLint location;
+    };
+
+    static constexpr const char* builtin_names[] = {
+        "model", "view", "projection", "color", "transform", "u_color", "u_texture", "u_modelViewProj"
+    };
+    static_assert(sizeof(builtin_names) / sizeof(builtin_names[0]) == static_cast<size_t>(BuiltinUniform::Count),
+                  "Every builtin uniform needs a name");
+
+    // Open addressing with linear probing, at most half full
+    std::vector<UniformSlot> uniform_table = std::vector<UniformSlot>(16, UniformSlot{0, -1});
+    size_t uniform_count = 0;
+    GLint builtin_locations[static_cast<size_t>(BuiltinUniform::Count)] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    bool instanced = false;
+    bool frame_block = false;
+    GLint material_block_size = 0;
+    std::unordered_map<std::string, BlockMember> material_members;
+
+    void bindUniformBlocks() {
+        GLuint index = glGetUniformBlockIndex(shader_id, "Frame");
+        if (index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(shader_id, index, FRAME_BINDING);
+            frame_block = true;
+        }
+
+        index = glGetUniformBlockIndex(shader_id, "Material");
+        if (index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(shader_id, index, MATERIAL_BINDING);
+            cacheBlockMembers(index);
+        }
+    }
+
+    void cacheBlockMembers(GLuint block) {
+        glGetActiveUniformBlockiv(shader_id, block, GL_UNIFORM_BLOCK_DATA_SIZE, &material_block_size);
+        GLint count = 0;
+        glGetActiveUniformBlockiv(shader_id, block, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+        if (count <= 0)
+            return;
+
+        std::vector<GLint> indices(count);
+        glGetActiveUniformBlockiv(shader_id, block, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+        std::vector<GLuint> members(indices.begin(), indices.end());
+        std::vector<GLint> offsets(count);
+        std::vector<GLint> types(count);
+        glGetActiveUniformsiv(shader_id, count, members.data(), GL_UNIFORM_OFFSET, offsets.data());
+        glGetActiveUniformsiv(shader_id, count, members.data(), GL_UNIFORM_TYPE, types.data());
+
+        for (GLint i = 0; i < count; ++i) {
+            char name[256];
+            GLsizei length = 0;
+            glGetActiveUniformName(shader_id, members[i], sizeof(name), &length, name);
+            // Members of a named block instance are reported as Material.name
+            std::string member(name, length);
+            if (member.compare(0, 9, "Material.") == 0)
+                member.erase(0, 9);
+            material_members[member] = {offsets[i], static_cast<GLenum>(types[i])};
+        }
+    }
 
     void cacheUniformLocations() {
         GLint count;
@@ -91,30 +347,169 @@ private:
 
             GLint location = glGetUniformLocation(shader_id, name);
             if (location != -1)
-                uniform_locations[name] = location;
+                insertUniform(hashUniformName(name, length), location);
+        }
+
+        for (size_t i = 0; i < static_cast<size_t>(BuiltinUniform::Count); ++i) {
+            const char* name = builtin_names[i];
+            builtin_locations[i] = getUniformLocation(UniformId(name, std::char_traits<char>::length(name)));
         }
     }
 
-    GLuint compile(const std::string& source, GLenum type) {
-        GLuint id = glCreateShader(type);
-        const char* src = source.c_str();
-        glShaderSource(id, 1, &src, nullptr);
-        glCompileShader(id);
-
-        GLint status;
-        glGetShaderiv(id, GL_COMPILE_STATUS, &status);
-        if (status != GL_TRUE) {
-            GLint length;
-            glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
-            std::string log(length, ' ');
-            glGetShaderInfoLog(id, length, &length, &log[0]);
-            std::cerr << "Shader compile error: " << log << std::endl;
-            return 0;
+    void insertUniform(uint64_t hash, GLint location) {
+        if ((uniform_count + 1) * 2 > uniform_table.size()) {
+            std::vector<UniformSlot> old(uniform_table.size() * 2, UniformSlot{0, -1});
+            old.swap(uniform_table);
+            uniform_count = 0;
+            for (const UniformSlot& slot : old) {
+                if (slot.hash != 0)
+                    insertUniform(slot.hash, slot.location);
+            }
+        }
+
+        size_t mask = uniform_table.size() - 1;
+        size_t i = hash & mask;
+        while (uniform_table[i].hash != 0 && uniform_table[i].hash != hash)
+            i = (i + 1) & mask;
+        if (uniform_table[i].hash == 0)
+            uniform_count++;
+        uniform_table[i] = {hash, location};
+    }
+
+    // Sorted by stage, the map order is not stable across runs
+    ShaderSources readSources() {
+        static const std::unordered_map<std::string, GLenum> shader_types = {
+            {"vertex", GL_VERTEX_SHADER},
+            {"fragment", GL_FRAGMENT_SHADER},
+            {"geometry", GL_GEOMETRY_SHADER},
+            {"compute", GL_COMPUTE_SHADER}
+        };
+
+        ShaderSources sources;
+        for (const auto& [type, path] : source_paths) {
+            auto it = shader_types.find(type);
+            if (it != shader_types.end())
+                sources.push_back({it->second, parse(path.c_str())});
         }
-        return id;
+        std::sort(sources.begin(), sources.end());
+        return sources;
     }
 
-    void checkLinkErrors(GLuint program) {
+    // Everything that belongs to the linked program, the paths stay
+    void swapProgram(Shader& other) {
+        std::swap(shader_id, other.shader_id);
+        std::swap(state, other.state);
+        std::swap(pending_shaders, other.pending_shaders);
+        std::swap(use_cache, other.use_cache);
+        std::swap(cache_key, other.cache_key);
+        std::swap(uniform_table, other.uniform_table);
+        std::swap(uniform_count, other.uniform_count);
+        std::swap(builtin_locations, other.builtin_locations);
+        std::swap(instanced, other.instanced);
+        std::swap(frame_block, other.frame_block);
+        std::swap(material_block_size, other.material_block_size);
+        std::swap(material_members, other.material_members);
+    }
+
+    void build(const ShaderSources& sources, ShaderBuild build_mode) {
+        ProgramCache& cache = ProgramCache::shared();
+        use_cache = cache.isEnabled();
+        cache_key = use_cache ? cache.makeKey(sources) : 0;
+        if (use_cache && cache.load(shader_id, cache_key)) {
+            use_cache = false;
+            finish(true);
+            return;
+        }
+
+        if (use_cache)
+            glProgramParameteri(shader_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        submit(sources);
+        if (build_mode == ShaderBuild::Blocking)
+            wait();
+    }
+
+    static std::shared_ptr<Shader>& placeholder() {
+        static std::shared_ptr<Shader> shader;
+        return shader;
+    }
+
+    static bool hasParallelCompile() {
+        static const bool supported = [] {
+            if (GLEW_KHR_parallel_shader_compile) {
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                return true;
+            }
+            if (GLEW_ARB_parallel_shader_compile) {
+                glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+                return true;
+            }
+            return false;
+        }();
+        return supported;
+    }
+
+    bool completionStatus() const {
+        GLint done = GL_FALSE;
+        glGetProgramiv(shader_id, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    // Compiles and links without asking for the results, so the driver can
+    // work on them in the background
+    void submit(const ShaderSources& sources) {
+        hasParallelCompile();
+        for (const auto& [type, source] : sources) {
+            GLuint id = glCreateShader(type);
+            const char* src = source.c_str();
+            glShaderSource(id, 1, &src, nullptr);
+            glCompileShader(id);
+            glAttachShader(shader_id, id);
+            pending_shaders.push_back(id);
+        }
+        glLinkProgram(shader_id);
+    }
+
+    // Reports compile and link errors of a submitted build and releases
+    // the stages
+    bool checkBuild() {
+        bool compiled = true;
+        for (GLuint id : pending_shaders) {
+            GLint status;
+            glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+            if (status != GL_TRUE) {
+                GLint length;
+                glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+                std::string log(length, ' ');
+                glGetShaderInfoLog(id, length, &length, &log[0]);
+                std::cerr << "Shader compile error: " << log << std::endl;
+                compiled = false;
+            }
+        }
+        bool linked = compiled && checkLinkErrors(shader_id);
+
+        for (GLuint id : pending_shaders) {
+            glDetachShader(shader_id, id);
+            glDeleteShader(id);
+        }
+        pending_shaders.clear();
+
+        if (linked && use_cache)
+            ProgramCache::shared().store(shader_id, cache_key);
+        return linked;
+    }
+
+    void finish(bool linked) {
+        state = linked ? ShaderState::Ready : ShaderState::Failed;
+        if (!linked)
+            return;
+
+        // Cache uniforms once after linking
+        cacheUniformLocations();
+        bindUniformBlocks();
+        instanced = glGetAttribLocation(shader_id, "i_model") >= 0;
+    }
+
+    bool checkLinkErrors(GLuint program) {
         GLint success;
         glGetProgramiv(program, GL_LINK_STATUS, &success);
         if (!success) {
@@ -122,6 +517,7 @@ private:
             glGetProgramInfoLog(program, 512, nullptr, info_log);
             std::cerr << "Shader link error: " << info_log << std::endl;
         }
+        return success;
     }
 
     std::string parse(const char* filename) {
@@ -142,38 +538,4 @@ private:
     }
 };
 
-// ----------------------------
-// Template specializations
-// ----------------------------
-
-template<>
-inline void Shader::setUniform<int>(const std::string& name, const int& value) {
-    glUniform1i(getUniformLocation(name), value);
-}
-
-template<>
-inline void Shader::setUniform<float>(const std::string& name, const float& value) {
-    glUniform1f(getUniformLocation(name), value);
-}
-
-template<>
-inline void Shader::setUniform<glm::vec2>(const std::string& name, const glm::vec2& value) {
-    glUniform2fv(getUniformLocation(name), 1, glm::value_ptr(value));
-}
-
-template<>
-inline void Shader::setUniform<glm::vec3>(const std::string& name, const glm::vec3& value) {
-    glUniform3fv(getUniformLocation(name), 1, glm::value_ptr(value));
-}
-
-template<>
-inline void Shader::setUniform<glm::vec4>(const std::string& name, const glm::vec4& value) {
-    glUniform4fv(getUniformLocation(name), 1, glm::value_ptr(value));
-}
-
-template<>
-inline void Shader::setUniform<glm::mat4>(const std::string& name, const glm::mat4& value) {
-    glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(value));
-}
-
 }
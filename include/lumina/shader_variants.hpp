@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "program_cache.hpp"
+#include "shader.hpp"
+
+namespace lumina
+{
+    // Variants of one shader that differ in their #defines, e.g. INSTANCED,
+    // TEXTURED or FOG. A define is "NAME" or "NAME=VALUE". Sources are
+    // preprocessed on the first request of a variant:
+    //
+    //   - the defines are inserted after the #version line
+    //   - #include "file" is replaced by the file, relative to the file
+    //     that includes it. Every file is included at most once per stage.
+    //
+    // Defines the sources never mention are left out, and variants whose
+    // preprocessed sources are identical share one program. Programs stay cached
+    // here and go through the ProgramCache like any other Shader.
+    class ShaderVariants
+    {
+    public:
+        using Defines = std::vector<std::string>;
+
+        // Stage names as for Shader, "vertex", "fragment", ...
+        explicit ShaderVariants(const std::unordered_map<std::string, std::string>& shader_paths)
+        : shader_paths(shader_paths)
+        {
+        }
+
+        // Builds the variant on first use. Returns nullptr when a source
+        // file cannot be read.
+        std::shared_ptr<Shader> get(const Defines& defines, ShaderBuild build = ShaderBuild::Blocking)
+        {
+            std::string key = makeDefinesKey(defines);
+            auto it = variants.find(key);
+            if (it != variants.end())
+                return it->second;
+
+            ShaderSources sources;
+            for (const auto& [stage, path] : shader_paths)
+            {
+                GLenum type = stageType(stage);
+                if (type == 0)
+                    continue;
+                std::string source;
+                if (!preprocess(path, defines, source))
+                    return nullptr;
+                sources.push_back({type, std::move(source)});
+            }
+            std::sort(sources.begin(), sources.end());
+
+            uint64_t hash = ProgramCache::hashSources(sources);
+            std::shared_ptr<Shader>& program = programs[hash];
+            if (!program)
+                program = std::make_shared<Shader>(std::move(sources), build);
+            variants[key] = program;
+            return program;
+        }
+
+        // Number of distinct programs built so far
+        size_t getProgramCount() const { return programs.size(); }
+
+        // Forgets the loaded files and variants, the next get() reads the
+        // sources again. Shaders handed out before stay valid.
+        void clear()
+        {
+            files.clear();
+            variants.clear();
+            programs.clear();
+        }
+
+        // Source of a stage with the defines and includes applied
+        bool preprocess(const std::string& path, const Defines& defines, std::string& result)
+        {
+            std::vector<std::string> included;
+            std::string body;
+            if (!expand(path, included, body))
+                return false;
+
+            std::string define_lines;
+            for (const std::string& define : sortedDefines(defines))
+            {
+                size_t equals = define.find('=');
+                // Defines the source never mentions would only split programs
+                if (!mentions(body, define.substr(0, equals)))
+                    continue;
+                define_lines += "#define ";
+                define_lines += equals == std::string::npos ? define : define.substr(0, equals) + " " + define.substr(equals + 1);
+                define_lines += "\n";
+            }
+
+            // #version has to stay the first line
+            size_t version = body.find("#version");
+            size_t insert = 0;
+            int line = 1;
+            if (version != std::string::npos)
+            {
+                size_t end = body.find('\n', version);
+                insert = end == std::string::npos ? body.size() : end + 1;
+                line = 1 + static_cast<int>(std::count(body.begin(), body.begin() + insert, '\n'));
+            }
+            if (!define_lines.empty())
+                define_lines += "#line " + std::to_string(line) + "\n";
+            result = body.substr(0, insert) + define_lines + body.substr(insert);
+            return true;
+        }
+
+    private:
+        std::unordered_map<std::string, std::string> shader_paths;
+        std::unordered_map<std::string, std::string> files;
+        std::unordered_map<std::string, std::shared_ptr<Shader>> variants;
+        std::unordered_map<uint64_t, std::shared_ptr<Shader>> programs;
+
+        static GLenum stageType(const std::string& stage)
+        {
+            if (stage == "vertex") return GL_VERTEX_SHADER;
+            if (stage == "fragment") return GL_FRAGMENT_SHADER;
+            if (stage == "geometry") return GL_GEOMETRY_SHADER;
+            if (stage == "compute") return GL_COMPUTE_SHADER;
+            return 0;
+        }
+
+        static Defines sortedDefines(const Defines& defines)
+        {
+            Defines sorted = defines;
+            std::sort(sorted.begin(), sorted.end());
+            sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+            return sorted;
+        }
+
+        // The same set of defines in any order gives the same key
+        static std::string makeDefinesKey(const Defines& defines)
+        {
+            std::string key;
+            for (const std::string& define : sortedDefines(defines))
+            {
+                key += define;
+                key += '\n';
+            }
+            return key;
+        }
+
+        const std::string* readFile(const std::string& path)
+        {
+            auto it = files.find(path);
+            if (it != files.end())
+                return &it->second;
+
+            std::ifstream file(path, std::ios::binary);
+            if (!file)
+            {
+                std::cerr << "File not found: " << path << std::endl;
+                return nullptr;
+            }
+            std::stringstream contents;
+            contents << file.rdbuf();
+            return &(files[path] = contents.str());
+        }
+
+        // Appends the file to result with its includes replaced
+        bool expand(const std::string& path, std::vector<std::string>& included, std::string& result)
+        {
+            std::string canonical = std::filesystem::path(path).lexically_normal().string();
+            if (std::find(included.begin(), included.end(), canonical) != included.end())
+                return true;
+            included.push_back(canonical);
+
+            const std::string* contents = readFile(path);
+            if (!contents)
+                return false;
+            if (included.size() > 1)
+                result += "#line 1\n";
+
+            std::istringstream lines(*contents);
+            std::string line;
+            int number = 0;
+            while (std::getline(lines, line))
+            {
+                number++;
+                std::string include;
+                if (!parseInclude(line, include))
+                {
+                    result += line;
+                    result += '\n';
+                    continue;
+                }
+
+                std::string include_path = (std::filesystem::path(path).parent_path() / include).string();
+                if (!expand(include_path, included, result))
+                {
+                    std::cerr << "Shader include failed: " << include_path << " in " << path << ":" << number << std::endl;
+                    return false;
+                }
+                result += "#line " + std::to_string(number + 1) + "\n";
+            }
+            return true;
+        }
+
+        static bool isIdentifier(char c)
+        {
+            return c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        }
+
+        static bool mentions(const std::string& source, const std::string& name)
+        {
+            for (size_t at = source.find(name); at != std::string::npos; at = source.find(name, at + 1))
+            {
+                size_t end = at + name.size();
+                if ((at == 0 || !isIdentifier(source[at - 1])) && (end == source.size() || !isIdentifier(source[end])))
+                    return true;
+            }
+            return false;
+        }
+
+        static bool parseInclude(const std::string& line, std::string& include)
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+                return false;
+            size_t open = line.find('"', start + 8);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+                return false;
+            include = line.substr(open + 1, close - open - 1);
+            return true;
+        }
+    };
+}
@@ -39,11 +39,11 @@ namespace lumina
         void render()
         {
             font_ptr->shader_ptr->bind();
-            glUniform4f(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_color"), terminal_string_color.x, terminal_string_color.y, terminal_string_color.z, 1.0f);
+            glUniform4f(font_ptr->shader_ptr->getUniformLocation(BuiltinUniform::UColor), terminal_string_color.x, terminal_string_color.y, terminal_string_color.z, 1.0f);
             int w, h;
             SDL_GetWindowSize(window, &w, &h);
             glm::mat4 ortho = glm::ortho(0.0f, (float)w, (float)h, 0.0f);
-            glUniformMatrix4fv(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_modelViewProj"), 1, GL_FALSE, glm::value_ptr(ortho));
+            glUniformMatrix4fv(font_ptr->shader_ptr->getUniformLocation(BuiltinUniform::UModelViewProj), 1, GL_FALSE, glm::value_ptr(ortho));
             int x, y;
             int padding_bottom = 20;
             int padding_left = 10;
@@ -52,7 +52,6 @@ namespace lumina
             terminal_render_string.append(terminal_prefix);
             terminal_render_string.append(terminal_input);
             font_ptr->drawString(float(x+padding_left), float(y-padding_bottom), terminal_render_string.c_str(), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); 
-            font_ptr->shader_ptr->unbind();
         }
 
         void select()
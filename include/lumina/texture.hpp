@@ -3,6 +3,7 @@
 #include <GL/glew.h>
 
 #include "../libs/stb/stb_image.h"
+#include "gl_state.hpp"
 
 namespace lumina {
 
@@ -10,22 +11,30 @@ class Texture
 {
 private:
     GLuint texture_id = 0;
+    std::string source_path;
     int width = 0;
     int height = 0;
+    mutable int bound_unit = 0;
 
 public:
     Texture() = default;
 
-    // Load from file
+    // Load from file. Loading again replaces the image and keeps the
+    // texture name.
     bool loadFromFile(const std::string& path)
     {
         // Use your preferred image loader (stb_image, etc.)
         int n;
-        unsigned char* data = stbi_load(path.c_str(), &width, &height, &n, 4);
+        int new_width, new_height;
+        unsigned char* data = stbi_load(path.c_str(), &new_width, &new_height, &n, 4);
         if (!data) return false;
+        width = new_width;
+        height = new_height;
+        source_path = path;
 
-        glGenTextures(1, &texture_id);
-        glBindTexture(GL_TEXTURE_2D, texture_id);
+        if (texture_id == 0)
+            glGenTextures(1, &texture_id);
+        GLState::shared().bindTexture(0, GL_TEXTURE_2D, texture_id);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
                      GL_RGBA, GL_UNSIGNED_BYTE, data);
 
@@ -40,20 +49,28 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLState::shared().bindTexture(0, GL_TEXTURE_2D, 0);
         stbi_image_free(data);
         return true;
     }
 
+    // Loads the file it was loaded from again
+    bool reload()
+    {
+        return !source_path.empty() && loadFromFile(source_path);
+    }
+
+    const std::string& getSourcePath() const { return source_path; }
+
     void bind(int unit = 0) const
     {
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glBindTexture(GL_TEXTURE_2D, texture_id);
+        GLState::shared().bindTexture(unit, GL_TEXTURE_2D, texture_id);
+        bound_unit = unit;
     }
 
     void unbind() const
     {
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLState::shared().bindTexture(bound_unit, GL_TEXTURE_2D, 0);
     }
 
     int getWidth() const { return width; }
@@ -63,7 +80,10 @@ public:
     ~Texture()
     {
         if (texture_id != 0)
+        {
+            GLState::shared().forgetTexture(texture_id);
             glDeleteTextures(1, &texture_id);
+        }
     }
 };
 
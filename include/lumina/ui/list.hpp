@@ -32,15 +32,15 @@ public:
         glm::vec4 color = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
         drawUIRectangle(bounds.x, bounds.y, bounds.z, bounds.w, shader, mesh, color, w, h);
     
-        glEnable(GL_SCISSOR_TEST);
-        glScissor(bounds.x * w, (1.0f - bounds.w) * h, (bounds.z - bounds.x) * w, (bounds.w - bounds.y) * h);
+        lumina::GLState::shared().setEnabled(GL_SCISSOR_TEST, true);
+        lumina::GLState::shared().scissor(bounds.x * w, (1.0f - bounds.w) * h, (bounds.z - bounds.x) * w, (bounds.w - bounds.y) * h);
 
         for (auto& [name, child] : children)
         {
             child->render(w, h);
         }
 
-        glDisable(GL_SCISSOR_TEST);
+        lumina::GLState::shared().setEnabled(GL_SCISSOR_TEST, false);
     }
 
     void handleEvent(SDL_Event& event, int w, int h) override
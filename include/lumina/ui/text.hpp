@@ -61,11 +61,10 @@ class Text : public Element
         text_y += text_padding.y;
 
         font_ptr->shader_ptr->bind();
-        glUniform4f(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_color"), 1.0f, 1.0f, 1.0f, 1.0f);
+        glUniform4f(font_ptr->shader_ptr->getUniformLocation(lumina::BuiltinUniform::UColor), 1.0f, 1.0f, 1.0f, 1.0f);
         glm::mat4 ortho = glm::ortho(0.0f, (float)window_width, (float)window_height, 0.0f);
-        glUniformMatrix4fv(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_modelViewProj"), 1, GL_FALSE, glm::value_ptr(ortho));
+        glUniformMatrix4fv(font_ptr->shader_ptr->getUniformLocation(lumina::BuiltinUniform::UModelViewProj), 1, GL_FALSE, glm::value_ptr(ortho));
         font_ptr->drawString(text_x, text_y, text.c_str(), text_color);
-        font_ptr->shader_ptr->unbind();
 
         Element::render(window_width, window_height);
     }
@@ -117,8 +116,8 @@ class TextLines : public Element
 
         font_ptr->shader_ptr->bind();
         glm::mat4 ortho = glm::ortho(0.0f, (float)window_width, (float)window_height, 0.0f);
-        glUniformMatrix4fv(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_modelViewProj"), 1, GL_FALSE, glm::value_ptr(ortho));
-        glUniform4f(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_color"), text_color.r, text_color.g, text_color.b, text_color.a);
+        glUniformMatrix4fv(font_ptr->shader_ptr->getUniformLocation(lumina::BuiltinUniform::UModelViewProj), 1, GL_FALSE, glm::value_ptr(ortho));
+        glUniform4f(font_ptr->shader_ptr->getUniformLocation(lumina::BuiltinUniform::UColor), text_color.r, text_color.g, text_color.b, text_color.a);
 
         for (const std::string& line : lines)
         {
@@ -128,7 +127,6 @@ class TextLines : public Element
             current_y += text_size.y * line_spacing;
         }
 
-        font_ptr->shader_ptr->unbind();
         Element::render(window_width, window_height);
     }
 
@@ -210,11 +208,10 @@ class TextField : public Element
         text_x -= text_size.x / 2.0f;
         text_y += text_size.y / 2.0f;
         font_ptr->shader_ptr->bind();
-        glUniform4f(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_color"), 1.0f, 1.0f, 1.0f, 1.0f);
+        glUniform4f(font_ptr->shader_ptr->getUniformLocation(lumina::BuiltinUniform::UColor), 1.0f, 1.0f, 1.0f, 1.0f);
         glm::mat4 ortho = glm::ortho(0.0f, (float)window_width, (float)window_height, 0.0f);
-        glUniformMatrix4fv(glGetUniformLocation(font_ptr->shader_ptr->shader_id, "u_modelViewProj"), 1, GL_FALSE, glm::value_ptr(ortho));
+        glUniformMatrix4fv(font_ptr->shader_ptr->getUniformLocation(lumina::BuiltinUniform::UModelViewProj), 1, GL_FALSE, glm::value_ptr(ortho));
         font_ptr->drawString(text_x, text_y, text.c_str(), text_color);
-        font_ptr->shader_ptr->unbind();
 
         Element::render(window_width, window_height);
     }
@@ -30,7 +30,7 @@ inline void drawUIRectangle(float min_x, float min_y, float max_x, float max_y,
     shader_ptr->bind();
     mesh_ptr->bind();
 
-    int color_location = glGetUniformLocation(shader_ptr->shader_id, "color");
+    int color_location = shader_ptr->getUniformLocation(lumina::BuiltinUniform::Color);
     glUniform4fv(color_location, 1, glm::value_ptr(color));
 
     // Create the transformation matrix
@@ -44,14 +44,13 @@ inline void drawUIRectangle(float min_x, float min_y, float max_x, float max_y,
 
     transform = glm::translate(transform, glm::vec3(center_x * 2.0f - 1.0f, -(center_y * 2.0f - 1.0f), 0.0f));
     transform = glm::scale(transform, glm::vec3(scale_x * 2.0f, scale_y * 2.0f, 1.0f));
+    if (mesh_ptr->hasQuantizedPositions())
+        transform = transform * mesh_ptr->getPositionTransform();
 
-    int transform_loc = glGetUniformLocation(shader_ptr->shader_id, "transform");
+    int transform_loc = shader_ptr->getUniformLocation(lumina::BuiltinUniform::Transform);
     glUniformMatrix4fv(transform_loc, 1, GL_FALSE, glm::value_ptr(transform));
 
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    mesh_ptr->unbind();
-    shader_ptr->bind();
+    glDrawElements(GL_TRIANGLES, mesh_ptr->getNumIndices(), mesh_ptr->getIndexType(), 0);
 }
 
 inline void drawUITexture(float min_x, float min_y, float max_x, float max_y,
@@ -66,7 +65,7 @@ inline void drawUITexture(float min_x, float min_y, float max_x, float max_y,
     mesh_ptr->bind();
     texture_ptr->bind(0); // bind to texture unit 0
 
-    int tex_loc = glGetUniformLocation(shader_ptr->shader_id, "u_texture");
+    int tex_loc = shader_ptr->getUniformLocation(lumina::BuiltinUniform::UTexture);
     glUniform1i(tex_loc, 0);
 
     glm::mat4 transform = glm::mat4(1.0f);
@@ -77,15 +76,13 @@ inline void drawUITexture(float min_x, float min_y, float max_x, float max_y,
 
     transform = glm::translate(transform, glm::vec3(center_x * 2.0f - 1.0f, -(center_y * 2.0f - 1.0f), 0.0f));
     transform = glm::scale(transform, glm::vec3(scale_x * 2.0f, scale_y * 2.0f, 1.0f));
+    if (mesh_ptr->hasQuantizedPositions())
+        transform = transform * mesh_ptr->getPositionTransform();
 
-    int transform_loc = glGetUniformLocation(shader_ptr->shader_id, "transform");
+    int transform_loc = shader_ptr->getUniformLocation(lumina::BuiltinUniform::Transform);
     glUniformMatrix4fv(transform_loc, 1, GL_FALSE, glm::value_ptr(transform));
 
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-    texture_ptr->unbind();
-    mesh_ptr->unbind();
-    shader_ptr->unbind();
+    glDrawElements(GL_TRIANGLES, mesh_ptr->getNumIndices(), mesh_ptr->getIndexType(), 0);
 }
 
 
@@ -118,11 +115,10 @@ inline void drawText(const ::std::string& text, const glm::vec4& bounds, lumina:
 
     font.shader_ptr->bind();
 
-    glUniform4f(glGetUniformLocation(font.shader_ptr->shader_id, "u_color"), color.r, color.g, color.b, color.a);
+    glUniform4f(font.shader_ptr->getUniformLocation(lumina::BuiltinUniform::UColor), color.r, color.g, color.b, color.a);
     glm::mat4 ortho = glm::ortho(0.0f, (float)with, (float)height, 0.0f);
-    glUniformMatrix4fv(glGetUniformLocation(font.shader_ptr->shader_id, "u_modelViewProj"), 1, GL_FALSE, glm::value_ptr(ortho));
+    glUniformMatrix4fv(font.shader_ptr->getUniformLocation(lumina::BuiltinUniform::UModelViewProj), 1, GL_FALSE, glm::value_ptr(ortho));
     font.drawString(text_x, text_y, text.c_str(), color);
-    font.shader_ptr->unbind();
 
 
 }
@@ -1,11 +1,11 @@
 #pragma once
 
-#include <filesystem>
 #include <unordered_map>
 #include <memory>
 #include <string>
 #include <iostream>
 
+#include "lumina/file_watcher.hpp"
 #include "lumina/ui/system.hpp"
 #include "lumina/ui/element.hpp"
 #include "lumina/ui/loader.hpp"
@@ -13,6 +13,9 @@
 namespace lumina::ui
 {
 
+// Reloads UI layouts when their file changes. Changes come from the
+// FileWatcher, so calling reloadIfChanged() every frame costs a map lookup
+// and no file system access.
 class Watcher
 {
 public:
@@ -20,24 +23,33 @@ public:
         : ui_(ui), loader_(loader)
     {}
 
+    ~Watcher()
+    {
+        clear();
+    }
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    // Loads the layout on the first call and again after the file changed
     bool reloadIfChanged(const std::string& path,
                          std::shared_ptr<Element>& target,
                          bool default_active = false)
     {
-        namespace fs = std::filesystem;
-
-        if (!fs::exists(path))
+        Entry& entry = entries_[path];
+        if (entry.id == 0)
         {
-            std::cerr << "[UI::Watcher] File does not exist: "
-                      << path << std::endl;
-            return false;
+            entry.id = FileWatcher::shared().watch(path, [this, path](const std::string&) {
+                auto it = entries_.find(path);
+                if (it != entries_.end())
+                    it->second.changed = true;
+            });
         }
 
-        fs::file_time_type current_time = fs::last_write_time(path);
-
-        auto it = timestamps_.find(path);
-        if (it != timestamps_.end() && it->second == current_time)
+        if (!entry.changed)
             return false;
+        // A failed load waits for the next change
+        entry.changed = false;
 
         bool was_active = target
             ? target->isActive()
@@ -58,24 +70,31 @@ public:
         ui_.add(new_ui);
 
         target = new_ui;
-        timestamps_[path] = current_time;
 
         return true;
     }
 
+    // Stops watching, the next reloadIfChanged() of a path loads it again
     void clear()
     {
-        timestamps_.clear();
+        for (const auto& [path, entry] : entries_)
+        {
+            FileWatcher::shared().unwatch(entry.id);
+        }
+        entries_.clear();
     }
 
 private:
+    struct Entry
+    {
+        FileWatcher::WatchId id = 0;
+        bool changed = true;
+    };
+
     System& ui_;
     Loader& loader_;
 
-    std::unordered_map<
-        std::string,
-        std::filesystem::file_time_type
-    > timestamps_;
+    std::unordered_map<std::string, Entry> entries_;
 };
 
 }
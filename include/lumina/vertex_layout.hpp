@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace lumina
+{
+    // Description of one attribute inside a vertex buffer
+    struct VertexAttribute
+    {
+        GLuint location;
+        GLint components;
+        GLenum type;
+        GLboolean normalized;
+        GLuint offset; // in bytes, relative to the start of the vertex buffer
+    };
+
+    // One vertex buffer and the attributes sourced from it
+    struct VertexStream
+    {
+        const void* data;
+        size_t size; // in bytes
+        GLsizei stride;
+        std::vector<VertexAttribute> attributes;
+    };
+
+    // Attribute that has the same value for every vertex. It is not stored in
+    // the vertex buffer but set with glVertexAttrib4fv when the mesh is bound.
+    struct ConstantAttribute
+    {
+        GLuint location;
+        glm::vec4 value;
+    };
+
+    enum class VertexFormat
+    {
+        Float32,
+        Half,
+        Snorm16,
+        Unorm16,
+        Snorm8,
+        Unorm8
+    };
+
+    // Storage format per attribute. Positions stored in a normalized format
+    // are quantized against the mesh bounds; the matching dequantization is
+    // returned in PackedVertexLayout and applied to the model matrix.
+    struct VertexLayout
+    {
+        VertexFormat position = VertexFormat::Float32;
+        VertexFormat color = VertexFormat::Float32;
+        VertexFormat uv = VertexFormat::Float32;
+        VertexFormat normal = VertexFormat::Float32;
+        // Attributes with the same value for every vertex are dropped from the buffer
+        bool skip_constant = true;
+        // Index buffers shrink to 16 bit whenever the vertex count allows.
+        // 8 bit indices are opt-in, several drivers convert them on the CPU.
+        bool byte_indices = false;
+
+        // 16 bit positions, RGBA8 colors, half float uvs and 8 bit normals
+        static VertexLayout compact()
+        {
+            VertexLayout layout;
+            layout.position = VertexFormat::Snorm16;
+            layout.color = VertexFormat::Unorm8;
+            layout.uv = VertexFormat::Half;
+            layout.normal = VertexFormat::Snorm8;
+            return layout;
+        }
+    };
+
+    struct PackedVertexLayout
+    {
+        GLsizei stride = 0;
+        std::vector<VertexAttribute> attributes;
+        std::vector<ConstantAttribute> constants;
+        // position = stored * position_scale + position_offset
+        glm::vec3 position_offset = glm::vec3(0.0f);
+        glm::vec3 position_scale = glm::vec3(1.0f);
+    };
+
+    struct PackedVertices
+    {
+        std::vector<unsigned char> data;
+        PackedVertexLayout layout;
+    };
+
+    inline GLenum vertexFormatType(VertexFormat format)
+    {
+        switch (format)
+        {
+            case VertexFormat::Half: return GL_HALF_FLOAT;
+            case VertexFormat::Snorm16: return GL_SHORT;
+            case VertexFormat::Unorm16: return GL_UNSIGNED_SHORT;
+            case VertexFormat::Snorm8: return GL_BYTE;
+            case VertexFormat::Unorm8: return GL_UNSIGNED_BYTE;
+            default: return GL_FLOAT;
+        }
+    }
+
+    inline size_t vertexFormatComponentSize(VertexFormat format)
+    {
+        switch (format)
+        {
+            case VertexFormat::Half:
+            case VertexFormat::Snorm16:
+            case VertexFormat::Unorm16: return 2;
+            case VertexFormat::Snorm8:
+            case VertexFormat::Unorm8: return 1;
+            default: return 4;
+        }
+    }
+
+    inline bool isNormalizedFormat(VertexFormat format)
+    {
+        return format != VertexFormat::Float32 && format != VertexFormat::Half;
+    }
+
+    // Smallest index type able to address max_index
+    inline GLenum selectIndexType(unsigned int max_index, bool allow_byte = false)
+    {
+        if (allow_byte && max_index <= 0xFF)
+            return GL_UNSIGNED_BYTE;
+        if (max_index <= 0xFFFF)
+            return GL_UNSIGNED_SHORT;
+        return GL_UNSIGNED_INT;
+    }
+
+    inline size_t indexTypeSize(GLenum type)
+    {
+        switch (type)
+        {
+            case GL_UNSIGNED_BYTE: return 1;
+            case GL_UNSIGNED_SHORT: return 2;
+            default: return 4;
+        }
+    }
+
+    // Narrows 32 bit indices to the given index type
+    inline std::vector<unsigned char> packIndices(const unsigned int* indices, size_t count, GLenum type)
+    {
+        std::vector<unsigned char> packed(count * indexTypeSize(type));
+        if (type == GL_UNSIGNED_BYTE)
+        {
+            for (size_t i = 0; i < count; i++)
+                packed[i] = static_cast<unsigned char>(indices[i]);
+        }
+        else if (type == GL_UNSIGNED_SHORT)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                uint16_t v = static_cast<uint16_t>(indices[i]);
+                std::memcpy(packed.data() + i * 2, &v, 2);
+            }
+        }
+        else
+        {
+            std::memcpy(packed.data(), indices, packed.size());
+        }
+        return packed;
+    }
+
+    inline void packComponent(VertexFormat format, float value, unsigned char* dst)
+    {
+        switch (format)
+        {
+            case VertexFormat::Float32: {
+                std::memcpy(dst, &value, 4);
+                break;
+            }
+            case VertexFormat::Half: {
+                uint16_t v = glm::packHalf1x16(value);
+                std::memcpy(dst, &v, 2);
+                break;
+            }
+            case VertexFormat::Snorm16: {
+                int16_t v = static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+                std::memcpy(dst, &v, 2);
+                break;
+            }
+            case VertexFormat::Unorm16: {
+                uint16_t v = static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+                std::memcpy(dst, &v, 2);
+                break;
+            }
+            case VertexFormat::Snorm8: {
+                int8_t v = static_cast<int8_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+                std::memcpy(dst, &v, 1);
+                break;
+            }
+            case VertexFormat::Unorm8: {
+                *dst = static_cast<unsigned char>(std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+                break;
+            }
+        }
+    }
+
+    // Packs position (3), color (3), uv (2) and normal (3) streams into one
+    // interleaved buffer using the given layout. Every attribute is padded to
+    // a multiple of 4 bytes. Missing streams (null or too short) are skipped.
+    inline PackedVertices packVertices(const std::vector<float>& positions,
+                                       const std::vector<float>* colors,
+                                       const std::vector<float>* uvs,
+                                       const std::vector<float>* normals,
+                                       const VertexLayout& layout = VertexLayout())
+    {
+        struct Source
+        {
+            GLuint location;
+            const std::vector<float>* values;
+            size_t width;
+            VertexFormat format;
+        };
+
+        const size_t count = positions.size() / 3;
+        Source sources[] = {
+            {0, &positions, 3, layout.position},
+            {1, colors, 3, layout.color},
+            {2, uvs, 2, layout.uv},
+            {3, normals, 3, layout.normal}
+        };
+
+        PackedVertices packed;
+        PackedVertexLayout& result = packed.layout;
+
+        // Quantization range for normalized positions
+        if (isNormalizedFormat(layout.position) && count > 0)
+        {
+            glm::vec3 min(positions[0], positions[1], positions[2]);
+            glm::vec3 max = min;
+            for (size_t i = 1; i < count; i++)
+            {
+                glm::vec3 p(positions[i * 3 + 0], positions[i * 3 + 1], positions[i * 3 + 2]);
+                min = glm::min(min, p);
+                max = glm::max(max, p);
+            }
+            bool is_signed = layout.position == VertexFormat::Snorm16 || layout.position == VertexFormat::Snorm8;
+            result.position_offset = is_signed ? (min + max) * 0.5f : min;
+            result.position_scale = is_signed ? (max - min) * 0.5f : (max - min);
+            result.position_scale = glm::max(result.position_scale, glm::vec3(1e-20f));
+        }
+
+        struct Packed
+        {
+            const Source* source;
+            GLuint offset;
+            GLint components;
+        };
+        std::vector<Packed> stored;
+
+        GLuint offset = 0;
+        for (const Source& source : sources)
+        {
+            if (!source.values || source.values->size() < count * source.width || count == 0)
+                continue;
+
+            if (layout.skip_constant && source.location != 0)
+            {
+                const float* first = source.values->data();
+                bool constant = true;
+                for (size_t i = 1; i < count && constant; i++)
+                    constant = std::equal(first, first + source.width, first + i * source.width);
+                if (constant)
+                {
+                    glm::vec4 value(0.0f, 0.0f, 0.0f, 1.0f);
+                    for (size_t k = 0; k < source.width; k++)
+                        value[static_cast<int>(k)] = first[k];
+                    result.constants.push_back({source.location, value});
+                    continue;
+                }
+            }
+
+            // RGBA8 colors carry an explicit opaque alpha
+            GLint components = static_cast<GLint>(source.width);
+            if (source.location == 1 && source.format == VertexFormat::Unorm8)
+                components = 4;
+
+            size_t bytes = (vertexFormatComponentSize(source.format) * components + 3) & ~size_t(3);
+            result.attributes.push_back({source.location, components, vertexFormatType(source.format),
+                                         static_cast<GLboolean>(isNormalizedFormat(source.format) ? GL_TRUE : GL_FALSE), offset});
+            stored.push_back({&source, offset, components});
+            offset += static_cast<GLuint>(bytes);
+        }
+        result.stride = static_cast<GLsizei>(offset);
+
+        packed.data.assign(count * result.stride, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned char* vertex = packed.data.data() + i * result.stride;
+            for (const Packed& attribute : stored)
+            {
+                const Source& source = *attribute.source;
+                const float* values = source.values->data() + i * source.width;
+                size_t component_size = vertexFormatComponentSize(source.format);
+                unsigned char* dst = vertex + attribute.offset;
+
+                for (GLint k = 0; k < attribute.components; k++)
+                {
+                    float value = k < static_cast<GLint>(source.width) ? values[k] : 1.0f;
+                    if (source.location == 0 && isNormalizedFormat(source.format))
+                        value = (value - result.position_offset[k]) / result.position_scale[k];
+                    packComponent(source.format, value, dst + k * component_size);
+                }
+            }
+        }
+
+        return packed;
+    }
+}
@@ -4,6 +4,11 @@
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
 
+#include "file_watcher.hpp"
+#include "frame_uniforms.hpp"
+#include "gl_state.hpp"
+#include "time/timer.hpp"
+
 namespace lumina
 {
     class Viewport
@@ -15,6 +20,9 @@ namespace lumina
         SDL_Window* window;
         SDL_GLContext gl_context;
 
+        time::Timer timer;
+        float elapsed_time = 0.0f;
+
         Viewport(const char* window_title, int frame_width, int frame_height)
         {
             if (SDL_Init(SDL_INIT_VIDEO) < 0)
@@ -64,6 +72,9 @@ namespace lumina
                 glew_initialized = true;
             }
 
+            // Lets GLState know the viewport without asking GL
+            GLState::shared().viewport(0, 0, frame_width, frame_height);
+
             std::cout << "Viewport initialized: " << window_title << std::endl;
         }
 
@@ -85,9 +96,17 @@ namespace lumina
             SDL_GL_MakeCurrent(window, gl_context);
         }
 
+        // Also delivers the file changes of the frame, see FileWatcher, and
+        // advances the time of the Frame uniform block
         void swapBuffers()
         {
             SDL_GL_SwapWindow(window);
+            GLState::shared().endFrame();
+            FileWatcher::shared().dispatch();
+
+            timer.update();
+            elapsed_time += timer.getDeltaTime();
+            FrameUniforms::shared().setTime(elapsed_time, timer.getDeltaTime());
         }
     };
 }
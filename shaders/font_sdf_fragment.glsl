@@ -0,0 +1,40 @@
+#version 430 core
+
+out vec4 fragColor;
+
+in vec2 v_tex_coord;
+
+// Signed distance field of the glyphs, 0.5 on the outline, growing inwards
+uniform sampler2D u_texture;
+uniform vec4 u_color;
+
+// Distances in field units, set by Font from TextEffects
+uniform vec4 u_outline_color;
+uniform float u_outline_width;
+uniform vec4 u_shadow_color;
+uniform vec2 u_shadow_offset;
+uniform float u_shadow_softness;
+
+const float EDGE = 0.5;
+
+void main()
+{
+    float field = texture(u_texture, v_tex_coord).r;
+    // About one screen pixel of the field, keeps the edge sharp at any size
+    float smoothing = max(fwidth(field) * 0.7, 1e-4);
+
+    float fill = smoothstep(EDGE - smoothing, EDGE + smoothing, field);
+    float outer_edge = EDGE - u_outline_width;
+    float body = smoothstep(outer_edge - smoothing, outer_edge + smoothing, field);
+    vec4 color = mix(u_outline_color, u_color, fill);
+    color.a *= body;
+
+    float shadow_distance = texture(u_texture, v_tex_coord - u_shadow_offset).r;
+    float shadow = smoothstep(outer_edge - u_shadow_softness - smoothing, outer_edge + smoothing, shadow_distance);
+    vec4 shadow_color = vec4(u_shadow_color.rgb, u_shadow_color.a * shadow);
+
+    // Text over its shadow
+    float alpha = color.a + shadow_color.a * (1.0 - color.a);
+    vec3 rgb = color.rgb * color.a + shadow_color.rgb * shadow_color.a * (1.0 - color.a);
+    fragColor = vec4(alpha > 0.0 ? rgb / alpha : vec3(0.0), alpha);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+
+layout (location = 0) in vec3 a_pos;
+// Per instance model matrix, one column per location (4 to 7)
+layout (location = 4) in mat4 i_model;
+
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec2 viewport_size;
+    float time;
+    float delta_time;
+};
+
+void main() {
+    gl_Position = view_projection * i_model * vec4(a_pos, 1.0);
+}
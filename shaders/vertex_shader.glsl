@@ -6,8 +6,16 @@ layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec3 i_pos;
 layout (location = 2) in float i_rot;
 
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec2 viewport_size;
+    float time;
+    float delta_time;
+};
 
 void main() {
     mat4 model = mat4(1.0); // Initialize as identity matrix